@@ -30,9 +30,20 @@
 #include "i2c.h"
 #include "bme68x.h"
 #include "CAN.h"
+#include "CAN_distributor.h"
+#include "Generic_CAN_Ids.h"
+#include "baro_vario.h"
+
+#if ACTIVATE_BARO_VARIO && ! ACTIVATE_OAT_SENSOR
+#error the backup vario needs the BME68x
+#endif
 
 #if ACTIVATE_OAT_SENSOR
 
+#if ACTIVATE_BARO_VARIO
+#define BARO_LOCAL_DECIMATION	5 // climb to the local audio controller @ 10 Hz
+#endif
+
 I2C_HandleTypeDef hi2c1;
 static uint8_t dev_addr;
 
@@ -148,21 +159,88 @@ private:
   type output;
 };
 
+//! forced mode cycle of the sensing task
+typedef struct
+{
+  uint32_t period_ms;		//!< one pressure sample each
+  uint8_t os_pres;
+  uint8_t os_temp;
+  uint8_t os_hum;		//!< only on humidity cycles
+  unsigned humidity_cycles;	//!< one humidity sample every n cycles
+  unsigned report_cycles;	//!< one temperature + humidity frame every n humidity samples
+  float filter_feedback;	//!< IIR for temperature and humidity, per humidity sample
+} measurement_schedule_t;
+
+#if ACTIVATE_BARO_VARIO
+/*!
+ * Pressure stream @ 50 Hz for the backup vario: temperature 1x, pressure 4x,
+ * no humidity, 15.1 ms per forced mode measurement.
+ * Once per second humidity is added (17.1 ms) without a gap in the pressure stream.
+ */
+static const measurement_schedule_t schedule =
+  {
+    BARO_VARIO_PERIOD_MS,
+    BME68X_OS_4X, BME68X_OS_1X, BME68X_OS_1X, // the alpha-beta filter does the smoothing
+    1000 / BARO_VARIO_PERIOD_MS,
+    1,
+    0.6f // 1 Hz
+  };
+#else
+//! full oversampling @ 5 Hz, filtered values sent @ 1 Hz
+static const measurement_schedule_t schedule =
+  {
+    200,
+    BME68X_OS_16X, BME68X_OS_16X, BME68X_OS_16X,
+    1,
+    5,
+    0.9f // 5 Hz
+  };
+#endif
+
+#if ACTIVATE_BARO_VARIO
+static inline uint16_t
+saturate (uint32_t value)
+{
+  return value > 0xffff ? 0xffff : value;
+}
+#endif
+
+/*! trigger one forced mode measurement and wait for the result
+ *
+ * < BME68X_OK: error, > BME68X_OK: warning like no new data */
+static int8_t
+measure (struct bme68x_data &data, uint32_t duration_ms, struct bme68x_dev &bme)
+{
+  uint8_t n_fields;
+  int8_t result = bme68x_set_op_mode (BME68X_FORCED_MODE, &bme);
+  if( result != BME68X_OK)
+    return result;
+  delay( duration_ms);
+  return bme68x_get_data (BME68X_FORCED_MODE, &data, &n_fields, &bme);
+}
+
 void StartSensingTask (void *argument)
 {
   struct bme68x_dev bme;
-  struct bme68x_conf conf;
+  struct bme68x_conf baro_conf;
+  struct bme68x_conf tph_conf;
   struct bme68x_heatr_conf heatr_conf;
   struct bme68x_data data;
-  uint8_t n_fields;
 
-  IIR_filter <float> humidity_filter( 0.9f);
-  IIR_filter <float> temperature_filter( 0.9f);
+  IIR_filter <float> humidity_filter( schedule.filter_feedback);
+  IIR_filter <float> temperature_filter( schedule.filter_feedback);
 
   CAN_packet p (0x120, 8);
+#if ACTIVATE_BARO_VARIO
+  baro_vario_filter vario;
+  CAN_packet climb (c_CID_AUD_Baro_Vario, 8);
+#endif
   while (true) // try initialization again and again
     {
       delay( 100);
+#if ACTIVATE_BARO_VARIO
+      vario.reset();
+#endif
 
       CAN_init ();
       MX_I2C1_Init ();
@@ -172,14 +250,18 @@ void StartSensingTask (void *argument)
       if( BME68X_OK != bme68x_init (&bme))
 	continue;
 
-      conf.filter = BME68X_FILTER_OFF;
-      conf.odr = BME68X_ODR_NONE;
-      conf.os_hum = BME68X_OS_16X;
-      conf.os_pres = BME68X_OS_16X;
-      conf.os_temp = BME68X_OS_16X;
+      baro_conf.filter = BME68X_FILTER_OFF;
+      baro_conf.odr = BME68X_ODR_NONE;
+      baro_conf.os_hum = BME68X_OS_NONE;
+      baro_conf.os_pres = schedule.os_pres;
+      baro_conf.os_temp = schedule.os_temp;
 
-      if( BME68X_OK != bme68x_set_conf (&conf, &bme))
-	continue;
+      tph_conf = baro_conf;
+      tph_conf.os_hum = schedule.os_hum;
+
+      uint32_t baro_ms = (bme68x_get_meas_dur (BME68X_FORCED_MODE, &baro_conf, &bme) + 999) / 1000;
+      uint32_t tph_ms  = (bme68x_get_meas_dur (BME68X_FORCED_MODE, &tph_conf,  &bme) + 999) / 1000;
+      ASSERT( tph_ms < schedule.period_ms);
 
       heatr_conf.enable = BME68X_DISABLE; /* Enabling this causes to high temperature values for quick consecutive readings*/
       heatr_conf.heatr_temp = 300;
@@ -188,34 +270,77 @@ void StartSensingTask (void *argument)
       if( BME68X_OK != bme68x_set_heatr_conf (BME68X_FORCED_MODE, &heatr_conf, &bme))
 	continue;
 
-      if( BME68X_OK != bme68x_set_op_mode (BME68X_FORCED_MODE, &bme))
+      if( BME68X_OK != bme68x_set_conf (&tph_conf, &bme))
 	continue;
+      bool tph_active = true;
 
-      delay(200);
-
-      unsigned decimation_counter = 0;
+      unsigned humidity_counter = 0;
+      unsigned report_counter = 0;
+#if ACTIVATE_BARO_VARIO
+      unsigned local_counter = 0;
+      uint32_t max_cycle_usec = 0;
+#endif
 
-      for( Synchronous_Timer t(200); true; t.sync()) /* Enter cyclic measurement mode @ 5 Hz */
+      for( Synchronous_Timer t( schedule.period_ms); true; t.sync()) /* Enter cyclic measurement mode */
 	{
-	  if( BME68X_OK != bme68x_set_op_mode (BME68X_FORCED_MODE, &bme))
+	  bool tph = humidity_counter + 1 >= schedule.humidity_cycles;
+	  if( tph != tph_active)
+	    {
+	      if( BME68X_OK != bme68x_set_conf (tph ? &tph_conf : &baro_conf, &bme))
+		break; // re-initialize
+	      tph_active = tph;
+	    }
+
+#if ACTIVATE_BARO_VARIO
+	  uint64_t start = getTime_usec();
+#endif
+	  int8_t result = measure (data, tph ? tph_ms : baro_ms, bme);
+	  if( result < BME68X_OK)
 	    break; // re-initialize
+	  if( result > BME68X_OK)
+	    continue; // skip this sample, a humidity cycle is repeated
+
+#if ACTIVATE_BARO_VARIO
+	  vario.step( data.pressure);
+	  climb.data_sh[0] = vario.get_climb_mm_s();
+
+	  // trigger -> climb available, the filter lag comes on top
+	  uint32_t cycle_usec = (uint32_t)( getTime_usec() - start);
+	  if( cycle_usec > max_cycle_usec)
+	    max_cycle_usec = cycle_usec;
 
-	  /* Check if rslt == BME68X_OK, report or handle if otherwise */
-	  if (BME68X_OK == bme68x_get_data (BME68X_FORCED_MODE, &data, &n_fields, &bme))
+	  if( ++local_counter >= BARO_LOCAL_DECIMATION)
 	    {
-	      p.data_f[0] = temperature_filter.step( data.temperature);
-	      p.data_f[1] = humidity_filter.step( data.humidity * 0.01f); // percent -> float number
-
-	      // send new filtered data @ 1 Hz
-	      ++ decimation_counter;
-	      if( decimation_counter >= 5)
-		{
-		  decimation_counter=0;
-		  CAN_send (p);
-		}
+	      local_counter = 0;
+	      distribute_local_CAN_packet( climb);
 	    }
-	  else
-	    break; // re-initialize
+#endif
+
+	  if( ! tph)
+	    {
+	      ++humidity_counter;
+	      continue;
+	    }
+	  humidity_counter = 0;
+
+	  p.data_f[0] = temperature_filter.step( data.temperature);
+	  p.data_f[1] = humidity_filter.step( data.humidity * 0.01f); // percent -> float number
+
+	  if( ++report_counter >= schedule.report_cycles)
+	    {
+	      report_counter = 0;
+	      CAN_send (p);
+	    }
+
+#if ACTIVATE_BARO_VARIO
+	  vario.set_atmosphere( data.temperature, data.pressure);
+
+	  climb.data_h[1] = saturate( max_cycle_usec);
+	  climb.data_h[2] = BARO_VARIO_LAG_MS;
+	  climb.data_h[3] = BARO_VARIO_LAG_MS + (max_cycle_usec + 999) / 1000;
+	  CAN_send (climb);
+	  max_cycle_usec = 0;
+#endif
 	}
     }
 }
@@ -239,7 +364,11 @@ MX_I2C1_Init (void)
 
   /* USER CODE END I2C1_Init 1 */
   hi2c1.Instance = I2C1;
+#if ACTIVATE_BARO_VARIO
+  hi2c1.Init.ClockSpeed = 400000; // fast mode for the 50 Hz measurement cycle
+#else
   hi2c1.Init.ClockSpeed = 100000;
+#endif
   hi2c1.Init.DutyCycle = I2C_DUTYCYCLE_2;
   hi2c1.Init.OwnAddress1 = 0;
   hi2c1.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
@@ -74,6 +74,7 @@ extern uint64_t getTime_usec(void);
 #define configCHECK_FOR_STACK_OVERFLOW	2
 #define configUSE_RECURSIVE_MUTEXES		1
 #define configQUEUE_REGISTRY_SIZE		10
+#define configUSE_QUEUE_SETS			1
 
 /* Set the following definitions to 1 to include the API function, or zero
 to exclude the API function. */
@@ -100,8 +101,10 @@ configKERNEL_INTERRUPT_PRIORITY setting.  Here 15 corresponds to the lowest
 NVIC value of 255. */
 #define configLIBRARY_KERNEL_INTERRUPT_PRIORITY	15
 
-#if 1
+#if defined( __arm__)
 #define configASSERT(x) if(!(x)){__asm volatile ( "bkpt 0" );}
+#elif 1 // host benchmarks, see host/FreeRTOS_host
+#define configASSERT(x) if(!(x)){__builtin_trap();}
 #else
 #define configASSERT(x)
 #endif
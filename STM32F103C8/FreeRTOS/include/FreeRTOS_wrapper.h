@@ -125,6 +125,15 @@ public:
 		return xQueueSend(the_queue, &item, TicksToWait) != pdFALSE;
 	}
 
+	//!  Queue send method, item goes ahead of all waiting ones
+	//! \param  item object to be sent
+	//! \param TicksToWait maximum time to wait (optional)
+	inline bool send_to_front(const items &item,
+			unsigned TicksToWait = INFINITE_WAIT) const
+	{
+		return xQueueSendToFront(the_queue, &item, TicksToWait) != pdFALSE;
+	}
+
 	//!  Queue receive method for use within ISR's
 	//! \param  item object to be received
 	inline bool receive_from_ISR(items &item) const
@@ -288,10 +297,50 @@ public:
 	{
 		return xSemaphoreTake( sema, TicksToWait) != pdFALSE;
 	}
+	SemaphoreHandle_t get_semaphore( void) const
+	{
+		return sema;
+	}
 private:
 	SemaphoreHandle_t sema;
 };
 
+//! Set of queues and semaphores a task can block on together
+//! \see xQueueCreateSet
+class Queue_set
+{
+public:
+//!  Queue_set constructor
+//! \param  length sum of the lengths of all member queues and semaphores
+	Queue_set(unsigned length)
+	: the_set( xQueueCreateSet(length))
+	{
+		ASSERT(the_set != 0);
+	}
+	//!  add an empty queue, before it is used
+	template<typename items> inline void add(Queue<items> &queue)
+	{
+		BaseType_t success = xQueueAddToSet(queue.get_queue(), the_set);
+		ASSERT(success != pdFALSE);
+	}
+	//!  add a semaphore that is not available, before it is used
+	inline void add(Semaphore &semaphore)
+	{
+		BaseType_t success = xQueueAddToSet(semaphore.get_semaphore(), the_set);
+		ASSERT(success != pdFALSE);
+	}
+	//!  wait for an item in one of the members
+	//! \return member holding an item or 0 on timeout
+	//! Each successful select must be followed by exactly one receive
+	//! or wait on a member.
+	inline QueueSetMemberHandle_t select(unsigned TicksToWait = INFINITE_WAIT)
+	{
+		return xQueueSelectFromSet(the_set, TicksToWait);
+	}
+private:
+	QueueSetHandle_t the_set; //!< freeRTOS's queue set handle
+};
+
 //! Mutex class
 class Mutex
 {
@@ -0,0 +1,267 @@
+/**
+ * @file    CAN_filter_test.cpp
+ * @brief   CAN_filter_plan against a model of the bxCAN acceptance filters
+ *
+ * The model applies the compiled banks like the hardware does in 16 bit
+ * scale: a matching list entry wins against a matching mask entry,
+ * between equal modes the lower bank number wins. Each scenario feeds all
+ * 2048 standard IDs and compares the resulting FIFO with what the
+ * subscriptions ask for: priority patterns -> FIFO 0, other patterns
+ * -> FIFO 1, nothing else. After a bulk overflow every frame without a
+ * priority pattern is expected in FIFO 1, after a priority overflow
+ * (no banks) every frame is accepted.
+ * Packing, register images and the add() results are checked, too.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -Wall -I../src -o CAN_filter_test CAN_filter_test.cpp
+ *   ./CAN_filter_test
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#include "CAN_filter.h"
+
+#define REJECTED	-1
+#define MAX_PATTERNS	100
+
+typedef struct
+{
+  uint16_t mask;
+  uint16_t value;
+  bool priority;
+} pattern_t;
+
+static bool pass = true;
+
+static void check( bool condition, const char *scenario, const char *what)
+{
+  if( ! condition)
+    {
+      printf( "%s: %s\n", scenario, what);
+      pass = false;
+    }
+}
+
+//! bxCAN in 16 bit scale, data frames with standard IDs only
+static int hardware_FIFO( const CAN_filter_bank_t *bank, unsigned banks, uint16_t id)
+{
+  uint16_t frame = id << 5; // RTR = IDE = 0
+  int mask_match = REJECTED;
+  for( unsigned b = 0; b < banks; ++b)
+    {
+      uint16_t half[4] =
+	{
+	  (uint16_t)bank[b].FR1, (uint16_t)(bank[b].FR1 >> 16),
+	  (uint16_t)bank[b].FR2, (uint16_t)(bank[b].FR2 >> 16)
+	};
+      if( bank[b].list_mode)
+	{
+	  for( unsigned k = 0; k < 4; ++k)
+	    if( frame == half[k])
+	      return bank[b].fifo; // list beats mask
+	}
+      else if( mask_match == REJECTED)
+	{
+	  for( unsigned k = 0; k < 4; k += 2)
+	    if( (frame & half[k + 1]) == (half[k] & half[k + 1]))
+	      mask_match = bank[b].fifo;
+	}
+    }
+  return mask_match;
+}
+
+//! what the subscriptions ask for
+static int expected_FIFO( const pattern_t *pattern, unsigned patterns, uint16_t id, bool bulk_overflow)
+{
+  bool bulk = bulk_overflow;
+  for( unsigned i = 0; i < patterns; ++i)
+    if( (id & pattern[i].mask) == (pattern[i].value & pattern[i].mask))
+      {
+	if( pattern[i].priority)
+	  return 0;
+	bulk = true;
+      }
+  return bulk ? 1 : REJECTED;
+}
+
+typedef struct
+{
+  const char *name;
+  unsigned banks;		//!< expected get_banks()
+  bool add_result;		//!< expected result of the last add()
+  bool bulk_overflow;
+} scenario_t;
+
+static void run( const scenario_t &s, const pattern_t *pattern, unsigned patterns)
+{
+  CAN_filter_plan plan;
+  bool result = true;
+  for( unsigned i = 0; i < patterns; ++i)
+    result = plan.add( pattern[i].mask, pattern[i].value, pattern[i].priority);
+
+  check( result == s.add_result, s.name, "add() result");
+  unsigned banks = plan.get_banks();
+  check( banks == s.banks, s.name, "number of banks");
+  check( banks <= CAN_FILTER_BANKS, s.name, "more banks than the hardware has");
+
+  CAN_filter_bank_t bank[CAN_FILTER_BANKS];
+  plan.compile( bank);
+
+  unsigned wrong = 0;
+  for( uint16_t id = 0; id <= CAN_STANDARD_ID_MASK; ++id)
+    {
+      int got = banks ? hardware_FIFO( bank, banks, id) : 0; // no banks: accept all into FIFO 0
+      int want = banks ? expected_FIFO( pattern, patterns, id, s.bulk_overflow) : 0;
+      if( got != want)
+	{
+	  if( wrong++ < 4)
+	    printf( "%s: ID 0x%03x in FIFO %d, expected %d\n", s.name, id, got, want);
+	  pass = false;
+	}
+    }
+  printf( "%-28s %2u banks %s\n", s.name, banks, wrong ? "FAIL" : "ok");
+}
+
+static void packing( void)
+{
+  const char *name = "register images";
+  CAN_filter_plan plan;
+  for( uint16_t id = 0x101; id <= 0x105; ++id)
+    plan.add( 0xffff, id);
+  plan.add( 0x7f0, 0x125); // value bits outside the mask are dropped
+  plan.add( 0xf700, 0x200); // mask bits outside 11 bits are dropped
+  plan.add( 0x7f0, 0x300);
+  plan.add( 0x7ff, 0x111, true);
+
+  check( plan.get_banks() == 5, name, "number of banks");
+  CAN_filter_bank_t bank[CAN_FILTER_BANKS];
+  plan.compile( bank);
+
+  // priority first: one list bank, the single ID fills all four slots
+  check( bank[0].list_mode && (bank[0].fifo == 0), name, "priority bank");
+  check( (bank[0].FR1 == (0x111u << 5 | 0x111u << 21)) && (bank[0].FR2 == bank[0].FR1), name, "priority list image");
+
+  // bulk: 4 + 1 IDs, the last slot repeats the last ID
+  check( bank[1].list_mode && (bank[1].fifo == 1), name, "bulk list bank");
+  check( bank[1].FR1 == (0x101u << 5 | 0x102u << 21), name, "list FR1");
+  check( bank[1].FR2 == (0x103u << 5 | 0x104u << 21), name, "list FR2");
+  check( (bank[2].FR1 == (0x105u << 5 | 0x105u << 21)) && (bank[2].FR2 == bank[2].FR1), name, "partial list bank");
+
+  // mask pairs: ID in the low half, mask with RTR and IDE bits in the high half
+  check( ! bank[3].list_mode && (bank[3].fifo == 1), name, "bulk mask bank");
+  check( bank[3].FR1 == (0x120u << 5 | (0x7f0u << 5 | 0x18) << 16), name, "mask FR1");
+  check( bank[3].FR2 == (0x200u << 5 | (0x700u << 5 | 0x18) << 16), name, "mask FR2");
+  check( bank[4].FR1 == (0x300u << 5 | (0x7f0u << 5 | 0x18) << 16), name, "second mask bank");
+  check( bank[4].FR2 == bank[4].FR1, name, "partial mask bank");
+
+  // a remote frame never passes a mask bank
+  uint16_t remote = 0x120 << 5 | 0x10;
+  check( (remote & (uint16_t)(bank[3].FR1 >> 16)) != (uint16_t)bank[3].FR1, name, "RTR ignored");
+  printf( "%-28s %2u banks %s\n", name, plan.get_banks(), pass ? "ok" : "FAIL");
+}
+
+int main( void)
+{
+  packing();
+
+  {
+    static const pattern_t p[] =
+      {
+	{ 0x7ff, 0x120, false }, { 0x7ff, 0x121, false }, { 0x7f0, 0x400, false },
+	{ 0x7ff, 0x280, true }, { 0x7ff, 0x281, true }, { 0x700, 0x500, true },
+	{ 0x7ff, 0x120, false } // duplicate
+      };
+    static const scenario_t s = { "mixed subscriptions", 4, true, false };
+    run( s, p, sizeof( p) / sizeof( p[0]));
+  }
+  {
+    // a bulk list entry would take 0x123 into FIFO 1, before or after the priority pair
+    static const pattern_t p[] =
+      {
+	{ 0x7ff, 0x123, false }, { 0x7f0, 0x120, true }, { 0x7ff, 0x12f, false },
+	{ 0x7ff, 0x200, false }
+      };
+    static const scenario_t s = { "list over mask, bulk", 2, true, false };
+    run( s, p, sizeof( p) / sizeof( p[0]));
+  }
+  {
+    // a priority list entry inside a bulk mask pair goes to FIFO 0
+    static const pattern_t p[] =
+      {
+	{ 0x700, 0x200, false }, { 0x7ff, 0x205, true }
+      };
+    static const scenario_t s = { "list over mask, priority", 2, true, false };
+    run( s, p, sizeof( p) / sizeof( p[0]));
+  }
+  {
+    // 60 bulk IDs = 15 banks: one accept-all bank, the priority banks stay
+    static pattern_t p[MAX_PATTERNS];
+    unsigned n = 0;
+    p[n++] = (pattern_t){ 0x7ff, 0x010, true };
+    p[n++] = (pattern_t){ 0x7f8, 0x020, true };
+    for( unsigned i = 0; i < 60; ++i)
+      p[n++] = (pattern_t){ 0x7ff, (uint16_t)(0x300 + i), false };
+    static const scenario_t s = { "bulk overflow", 3, false, true };
+    run( s, p, n);
+
+    // later priority patterns still get filtered
+    p[n++] = (pattern_t){ 0x7ff, 0x011, true };
+    static const scenario_t s2 = { "priority after bulk overflow", 3, true, true };
+    run( s2, p, n);
+  }
+  {
+    // 29 priority pairs need 15 banks: no filtering at all
+    static pattern_t p[MAX_PATTERNS];
+    unsigned n = 0;
+    for( unsigned i = 0; i < 29; ++i)
+      p[n++] = (pattern_t){ 0x7f0, (uint16_t)(i << 4), true };
+    static const scenario_t s = { "priority overflow", 0, false, false };
+    run( s, p, n);
+  }
+  {
+    // 14 banks exactly: 13 priority list banks + 4 bulk IDs
+    static pattern_t p[MAX_PATTERNS];
+    unsigned n = 0;
+    for( unsigned i = 0; i < 52; ++i)
+      p[n++] = (pattern_t){ 0x7ff, (uint16_t)(0x100 + i), true };
+    for( unsigned i = 0; i < 4; ++i)
+      p[n++] = (pattern_t){ 0x7ff, (uint16_t)(0x600 + i), false };
+    static const scenario_t s = { "all banks used", 14, true, false };
+    run( s, p, n);
+
+    // one more bulk ID collapses the bulk list into the accept-all bank
+    p[n++] = (pattern_t){ 0x7ff, 0x604, false };
+    static const scenario_t s2 = { "one bulk ID too many", 14, false, true };
+    run( s2, p, n);
+  }
+  {
+    CAN_filter_plan plan;
+    check( plan.get_banks() == 0, "empty plan", "banks");
+    plan.add( 0x7ff, 0x100);
+    plan.clear();
+    check( plan.get_banks() == 0, "cleared plan", "banks");
+  }
+
+  printf( pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
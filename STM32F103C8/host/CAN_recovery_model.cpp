@@ -0,0 +1,253 @@
+/**
+ * @file    CAN_recovery_model.cpp
+ * @brief   Bus-off recovery against a model of the bxCAN error states
+ *
+ * The model queues one frame per millisecond. While the bus is faulty
+ * (shorted or open) every transmission fails: TEC += 8, at TEC > 255
+ * the node goes bus-off. Automatic retransmission repeats the frame
+ * every model step. A restart needs 128 x 11 recessive bits
+ * (1408 us at 1 Mbit/s) on a healthy bus, a reinitialization resets the
+ * error counters at once but cannot synchronize on a dominant bus.
+ * Successful transmissions decrement TEC.
+ * The supervisor task is modelled by calling CAN_bus_off_recovery
+ * on the bus-off interrupt and whenever its timeout expires.
+ *
+ * Each scenario checks recovery count, time to recover and the
+ * muted time against limits and prints the outage timeline.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -I../src -o CAN_recovery_model CAN_recovery_model.cpp
+ *   ./CAN_recovery_model [-v]
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CAN_recovery.h"
+
+#define STEP_USEC		100
+#define RECOVERY_SEQUENCE_USEC	1408 // 128 x 11 bits at 1 Mbit/s
+#define FRAME_PERIOD_USEC	1000
+
+static bool verbose;
+
+//! bxCAN error confinement, as far as the recovery is concerned
+class bxCAN_model
+{
+public:
+  bxCAN_model( void)
+  : TEC( 0), bus_off( false), restarting( false), synchronized( true), pending( false),
+    recessive_usec( 0)
+  {}
+
+  //! returns true when entering bus-off (the interrupt)
+  bool step( bool bus_faulty, bool new_frame)
+  {
+    pending |= new_frame;
+    if( ! synchronized) // after a reset: wait for 11 recessive bits
+      {
+	if( ! bus_faulty)
+	  synchronized = true;
+	return false;
+      }
+    if( bus_off)
+      {
+	if( restarting)
+	  {
+	    recessive_usec = bus_faulty ? 0 : recessive_usec + STEP_USEC;
+	    if( recessive_usec >= RECOVERY_SEQUENCE_USEC)
+	      {
+		bus_off = restarting = false;
+		TEC = 0;
+	      }
+	  }
+	return false;
+      }
+    if( ! pending)
+      return false;
+    if( ! bus_faulty)
+      {
+	pending = false;
+	if( TEC > 0)
+	  --TEC;
+	return false;
+      }
+    TEC += 8;
+    if( TEC > 255)
+      {
+	bus_off = true;
+	return true;
+      }
+    return false;
+  }
+
+  void restart( void)
+  {
+    restarting = true;
+    recessive_usec = 0;
+  }
+
+  void reinitialize( void)
+  {
+    TEC = 0;
+    bus_off = restarting = false;
+    synchronized = false;
+  }
+
+  bool is_off( void) const //!< as CAN_is_bus_off()
+  {
+    return bus_off || ! synchronized;
+  }
+
+private:
+  unsigned TEC;
+  bool bus_off;
+  bool restarting;
+  bool synchronized;
+  bool pending;		//!< frame in a TX mailbox
+  uint32_t recessive_usec;
+};
+
+typedef struct
+{
+  const char *name;
+  uint32_t duration_ms;
+  unsigned faults;		//!< number of fault intervals
+  uint32_t first_fault_ms;
+  uint32_t fault_ms;		//!< length of each fault
+  uint32_t fault_period_ms;	//!< distance between faults
+  // expectations
+  unsigned min_recoveries;
+  uint32_t max_recovery_ms;	//!< after the end of the fault
+  uint32_t max_final_backoff_ms;
+} scenario_t;
+
+static const scenario_t scenarios[] =
+{
+  { "glitch 5 ms",		2000, 1, 100, 5, 0,		1, 30, 10 },
+  { "short 3 s",		6000, 1, 100, 3000, 0,		1, CAN_RECOVERY_MAX_BACKOFF_MS + 60, CAN_RECOVERY_MAX_BACKOFF_MS },
+  { "flapping 20 ms / 300 ms",	4000, 6, 100, 20, 300,		6, 330, 320 }, // backoff 10 .. 320 ms
+  { "flapping, then stable",	20000, 3, 100, 20, 300,	4, 200, 40 },
+};
+
+static bool fault_active( const scenario_t &s, uint32_t t_ms, uint32_t &fault_end)
+{
+  for( unsigned i = 0; i < s.faults; ++i)
+    {
+      uint32_t start = s.first_fault_ms + i * s.fault_period_ms;
+      if( t_ms >= start && t_ms < start + s.fault_ms)
+	{
+	  fault_end = start + s.fault_ms;
+	  return true;
+	}
+    }
+  return false;
+}
+
+static bool run( const scenario_t &s)
+{
+  bxCAN_model node;
+  CAN_bus_off_recovery recovery;
+  uint32_t wakeup_ms = 0xffffffff;
+  uint32_t fault_end = 0;
+  uint32_t outage_start = 0;
+  uint32_t worst_after_fault = 0;
+  uint32_t muted_ms = 0;
+  unsigned restarts = 0, reinits = 0;
+
+  // "flapping, then stable": one more glitch after a long quiet time
+  scenario_t late = s;
+  bool with_late_glitch = strstr( s.name, "stable") != 0;
+
+  for( uint32_t t_usec = 0; t_usec < s.duration_ms * 1000; t_usec += STEP_USEC)
+    {
+      uint32_t t_ms = t_usec / 1000;
+      bool faulty = fault_active( s, t_ms, fault_end);
+      if( with_late_glitch && ! faulty)
+	{
+	  late.faults = 1;
+	  late.first_fault_ms = s.duration_ms - 5000; // > CAN_RECOVERY_STABLE_MS after the others
+	  faulty = fault_active( late, t_ms, fault_end);
+	}
+
+      bool interrupt = node.step( faulty, t_usec % FRAME_PERIOD_USEC == 0);
+
+      if( ! interrupt && ((t_usec % 1000) != 0 || (int32_t)( t_ms - wakeup_ms) < 0))
+	continue; // supervisor sleeps, it runs on the 1 ms tick
+
+      bool outage = recovery.is_outage();
+      switch( recovery.update( node.is_off(), t_ms))
+	{
+	case CAN_bus_off_recovery::RESTART:
+	  node.restart();
+	  ++restarts;
+	  break;
+	case CAN_bus_off_recovery::REINITIALIZE:
+	  node.reinitialize();
+	  ++reinits;
+	  break;
+	default:
+	  break;
+	}
+      uint32_t timeout = recovery.timeout( t_ms);
+      wakeup_ms = timeout == CAN_RECOVERY_NO_TIMEOUT ? 0xffffffff : t_ms + (timeout ? timeout : 1);
+
+      if( ! outage && recovery.is_outage())
+	{
+	  outage_start = t_ms;
+	  if( verbose)
+	    printf( "  %6u ms bus-off\n", t_ms);
+	}
+      else if( outage && ! recovery.is_outage())
+	{
+	  muted_ms += t_ms - outage_start;
+	  uint32_t after_fault = t_ms - fault_end;
+	  if( after_fault > worst_after_fault)
+	    worst_after_fault = after_fault;
+	  if( verbose)
+	    printf( "  %6u ms active, %u attempts, %u ms to recover, %u ms after the fault\n",
+		    t_ms, recovery.get_attempts(), recovery.get_last_recovery_ms(), after_fault);
+	}
+    }
+
+  bool pass = ! recovery.is_outage()
+      && recovery.get_recoveries() >= s.min_recoveries
+      && worst_after_fault <= s.max_recovery_ms
+      && recovery.get_backoff_ms() <= s.max_final_backoff_ms;
+
+  printf( "%-26s %s  recoveries %u  restarts %u  reinits %u  max %4u ms  "
+	  "worst after fault %4u ms  muted %5u ms  backoff %4u ms\n",
+	  s.name, pass ? "PASS" : "FAIL", recovery.get_recoveries(), restarts, reinits,
+	  recovery.get_max_recovery_ms(), worst_after_fault, muted_ms, recovery.get_backoff_ms());
+  return pass;
+}
+
+int main( int argc, char *argv[])
+{
+  verbose = (argc > 1) && (strcmp( argv[1], "-v") == 0);
+
+  bool pass = true;
+  for( const scenario_t &s : scenarios)
+    pass &= run( s);
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file    CAN_timestamp_test.cpp
+ * @brief   CAN_timestamp_mapper against synthetic captures
+ *
+ * Frames arrive every FRAME_PERIOD_USEC with 8 data bytes. The bxCAN
+ * capture is the SOF time plus a constant offset modulo 2^16, the RX
+ * interrupt runs CAN_SOF_TO_RX_IRQ_BITS, a random number of stuff bits
+ * and a random interrupt latency after the SOF. Every frame compares the
+ * SOF time returned with the true one.
+ * Scenarios add a clock drift between the capture counter and
+ * getTime_usec() and single outliers: a capture off by several hundred
+ * microseconds, once while learning and once with a learned offset, and
+ * an interrupt delayed by milliseconds.
+ * After the settle time each SOF time must be within the limit of the
+ * scenario, the frames after an outlier included. The outlier frame has
+ * a limit of its own: a capture error of a single frame can not be told
+ * from interrupt latency, a late interrupt must not matter.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -Wall -I../src -o CAN_timestamp_test CAN_timestamp_test.cpp
+ *   ./CAN_timestamp_test [-v]
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "CAN_timestamp.h"
+
+#define FRAME_PERIOD_USEC	1000
+#define DATA_BYTES		8
+#define MAX_STUFF_BITS		19 // 8 data bytes, standard ID
+#define NO_OUTLIER		0xffffffff
+
+static bool verbose;
+
+typedef struct
+{
+  const char *name;
+  uint32_t frames;
+  uint32_t start_usec;		//!< getTime_usec() at the first SOF, 32 bit wrap included
+  uint16_t capture_offset;	//!< capture - SOF time, modulo 2^16
+  unsigned max_latency_usec;	//!< interrupt latency 0 .. max
+  int drift_ppm;		//!< capture counter vs. getTime_usec()
+  uint32_t outlier_frame;	//!< index or NO_OUTLIER
+  int outlier_capture_usec;	//!< capture error of that frame
+  unsigned outlier_latency_usec; //!< extra interrupt latency of that frame
+  // expectations
+  uint32_t settle_frames;	//!< no limit before
+  unsigned max_error_usec;	//!< |SOF time - true SOF|, afterwards
+  unsigned max_outlier_error_usec;
+} scenario_t;
+
+static const scenario_t scenarios[] =
+{
+  { "steady",			 5000, 1000,       0x1234, 20,    0, NO_OUTLIER, 0, 0,	16, 45, 0 },
+  { "32 bit wrap",		 5000, 0xfffff000, 0xfedc, 20,    0, NO_OUTLIER, 0, 0,	16, 45, 0 },
+  { "slow interrupts",		 5000, 1000,       0x0042, 150,   0, NO_OUTLIER, 0, 0,	16, 175, 0 },
+  { "drift +50 ppm",		60000, 1000,       0x1234, 20,   50, NO_OUTLIER, 0, 0,	16, 45, 0 },
+  { "drift -50 ppm",		60000, 1000,       0x1234, 20,  -50, NO_OUTLIER, 0, 0,	16, 45, 0 },
+  { "late interrupt",		 5000, 1000,       0x1234, 20,    0, 1000, 0, 3000,	16, 45, 45 },
+  { "late capture, learned",	 5000, 1000,       0x1234, 20,    0, 1000, 700, 0,	16, 45, 45 },
+  { "early capture, learned",	 5000, 1000,       0x1234, 20,    0, 1000, -700, 0,	16, 45, 750 },
+  { "late capture, learning",	 5000, 1000,       0x1234, 20,    0, 5, 700, 0,	70, 45, 750 },
+};
+
+static bool run( const scenario_t &s)
+{
+  CAN_timestamp_mapper mapper;
+  srand( 1);
+
+  unsigned min_delay = CAN_SOF_TO_RX_IRQ_BITS( DATA_BYTES);
+  unsigned worst = 0;
+  unsigned worst_settling = 0;
+  unsigned outlier_error = 0;
+  uint32_t relearned = 0;
+
+  for( uint32_t n = 0; n < s.frames; ++n)
+    {
+      uint32_t elapsed = n * FRAME_PERIOD_USEC + rand() % 100;
+      uint32_t SOF = s.start_usec + elapsed;
+      int64_t drift = (int64_t)elapsed * s.drift_ppm / 1000000;
+      uint16_t capture = (uint16_t)( SOF + s.capture_offset + drift);
+      unsigned delay = min_delay + rand() % (MAX_STUFF_BITS + 1)
+	  + rand() % (s.max_latency_usec + 1);
+      if( n == s.outlier_frame)
+	{
+	  capture += s.outlier_capture_usec;
+	  delay += s.outlier_latency_usec;
+	}
+      uint32_t now = SOF + delay;
+
+      bool learned = mapper.is_learned();
+      uint32_t result = mapper.SOF_time( capture, now, DATA_BYTES);
+      if( learned && ! mapper.is_learned())
+	relearned = n;
+
+      int32_t error = (int32_t)( result - SOF);
+      unsigned magnitude = error < 0 ? -error : error;
+      if( n == s.outlier_frame)
+	outlier_error = magnitude;
+      else if( n < s.settle_frames)
+	{
+	  if( magnitude > worst_settling)
+	    worst_settling = magnitude;
+	}
+      else if( magnitude > worst)
+	worst = magnitude;
+
+      if( verbose && (magnitude > s.max_error_usec) && (n >= s.settle_frames) && (n != s.outlier_frame))
+	printf( "  frame %u: SOF time off by %d usec\n", n, error);
+    }
+
+  bool pass = mapper.is_learned() && (worst <= s.max_error_usec)
+      && (outlier_error <= s.max_outlier_error_usec);
+  printf( "%-26s %s  settling %4u usec  worst %4u usec  outlier frame %4u usec",
+	  s.name, pass ? "PASS" : "FAIL", worst_settling, worst, outlier_error);
+  if( relearned)
+    printf( "  relearned at frame %u", relearned);
+  printf( "\n");
+  return pass;
+}
+
+int main( int argc, char *argv[])
+{
+  verbose = (argc > 1) && (strcmp( argv[1], "-v") == 0);
+
+  bool pass = true;
+  for( const scenario_t &s : scenarios)
+    pass &= run( s);
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file    portmacro.h
+ * @brief   FreeRTOS port for host benchmarks: kernel code without a scheduler
+ *
+ * Just enough to compile queue.c, list.c and tasks.c on the Linux host
+ * and call the queue API from one thread before the scheduler starts:
+ * nothing ever blocks or switches, critical sections are empty.
+ * Nothing here models the Cortex-M3 interrupt masking or context switch.
+ * See spsc_benchmark.cpp.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define portCHAR		char
+#define portFLOAT		float
+#define portDOUBLE		double
+#define portLONG		long
+#define portSHORT		short
+#define portSTACK_TYPE		uint32_t
+#define portBASE_TYPE		long
+
+typedef portSTACK_TYPE StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY		( TickType_t ) 0xffffffffUL
+#define portTICK_TYPE_IS_ATOMIC	1
+#define portSTACK_GROWTH	( -1 )
+#define portTICK_PERIOD_MS	( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portBYTE_ALIGNMENT	8
+#define portPOINTER_SIZE_TYPE	uintptr_t
+
+#define portYIELD()
+#define portYIELD_WITHIN_API()
+#define portEND_SWITCHING_ISR( xSwitchRequired )	( void )( xSwitchRequired )
+#define portYIELD_FROM_ISR( x )				portEND_SWITCHING_ISR( x )
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()		0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR( x )		( void )( x )
+#define portDISABLE_INTERRUPTS()
+#define portENABLE_INTERRUPTS()
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+
+#define portTASK_FUNCTION_PROTO( vFunction, pvParameters )	void vFunction( void * pvParameters )
+#define portTASK_FUNCTION( vFunction, pvParameters )		void vFunction( void * pvParameters )
+
+#define portNOP()
+#define portINLINE		__inline
+#define portFORCE_INLINE	inline __attribute__( ( always_inline ) )
+#define portMEMORY_BARRIER()	__asm volatile ( "" ::: "memory" )
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PORTMACRO_H */
@@ -0,0 +1,265 @@
+/**
+ * @file    audio_latency_model.cpp
+ * @brief   Frame arrival -> set_frequency() latency of the audio controller
+ *
+ * Drives the unmodified decision logic (src/audio_logic.h) with a timed
+ * stream of c_CID_A57_Audio frames and models the audio controller task
+ * around it in two variants:
+ *
+ * polled:       the former loop, Synchronous_Timer of 10 ms, the queue
+ *               (3 entries) drained without waiting, delay( 100) while
+ *               no vario data is arriving
+ * event driven: Audio_Controller as it is, woken by each frame or by
+ *               the timeout of audio_logic_t
+ *
+ * Time is modelled in microseconds, the RTOS tick is 1 ms. Each frame
+ * reaches the task WAKE_USEC after its arrival (ISR, distributor task,
+ * context switches), one pass of the task loop takes LOOP_USEC.
+ * The latency of a vario frame ends when apply() calls set_frequency()
+ * with its result. Frames replaced by a newer one in the same pass are
+ * counted as superseded, their latency ends with that pass, too.
+ * The stream pauses regularly for longer than the
+ * CAN RX watchdog, frames after a pause are reported separately.
+ * Speed commander phases keep the periodic timeout of audio_logic_t busy,
+ * c_CID_A57_Signal frames arrive right behind some audio frames.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -I../src -I../FreeRTOS/include -o audio_latency_model
+ *       audio_latency_model.cpp ../src/signal_sequencer.cpp
+ *   ./audio_latency_model
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "Generic_CAN_Ids.h"
+#include "audio_logic.h"
+
+#define RUN_USEC		120000000ULL
+#define FRAME_PERIOD_USEC	49950	// sender clock 0.1 % fast: phase drifts over the tick grid
+#define FRAME_JITTER_USEC	3000
+#define BLOCK_USEC		20000000ULL	// vario, speed commander, pause
+#define CRUISING_USEC		4000000ULL
+#define PAUSE_USEC		2000000ULL	// > CAN_RX_TIMEOUT_MS
+#define SIGNAL_EVERY		40		// audio frames
+#define SIGNAL_DELAY_USEC	200
+
+#define WAKE_USEC		30
+#define LOOP_USEC		100
+#define POLL_PERIOD_USEC	10000
+#define SILENT_DELAY_USEC	100000
+#define POLLED_QUEUE_SIZE	3
+
+#define NO_DEADLINE		UINT64_MAX
+
+typedef struct
+{
+  uint64_t usec;	//!< arrival
+  uint32_t id;
+  uint8_t data[8];
+  bool vario;		//!< audio frame in vario mode: ends with set_frequency()
+  bool resume;		//!< first audio frame after a pause
+} arrival_t;
+
+//! latencies of one model
+class latencies
+{
+public:
+  latencies( void)
+  : superseded( 0), lost( 0)
+  {}
+
+  void add( const arrival_t &frame, uint64_t applied_usec)
+  {
+    (frame.resume ? resume : stream).push_back( applied_usec - frame.usec);
+  }
+
+  static void report( const char *name, std::vector <uint64_t> &samples)
+  {
+    if( samples.empty())
+      return;
+    std::sort( samples.begin(), samples.end());
+    uint64_t sum = 0;
+    for( uint64_t s : samples)
+      sum += s;
+    printf( "  %-8s %6zu  %7llu  %7llu  %7llu  %7llu  %7llu\n", name, samples.size(),
+	    (unsigned long long)samples.front(), (unsigned long long)( sum / samples.size()),
+	    (unsigned long long)samples[samples.size() / 2],
+	    (unsigned long long)samples[( samples.size() * 99) / 100],
+	    (unsigned long long)samples.back());
+  }
+
+  void report( const char *model)
+  {
+    printf( "%s: superseded %u, lost %u\n", model, superseded, lost);
+    printf( "  frames    count      min     mean      p50      p99      max / us\n");
+    report( "stream", stream);
+    report( "resume", resume);
+  }
+
+  std::vector <uint64_t> stream, resume;
+  unsigned superseded;
+  unsigned lost;
+};
+
+static std::vector <arrival_t> make_stream( void)
+{
+  std::vector <arrival_t> frames;
+  int32_t climb = 0;
+  bool paused = false;
+  unsigned count = 0;
+  srand( 1);
+
+  for( uint64_t t = FRAME_PERIOD_USEC; t < RUN_USEC; t += FRAME_PERIOD_USEC)
+    {
+      uint64_t in_block = t % BLOCK_USEC;
+      if( in_block >= BLOCK_USEC - PAUSE_USEC)
+	{
+	  paused = true;
+	  continue;
+	}
+      bool cruising = in_block >= BLOCK_USEC - PAUSE_USEC - CRUISING_USEC;
+
+      climb += rand() % 401 - 200;
+      climb = climb > 5000 ? 5000 : climb < -5000 ? -5000 : climb;
+      int16_t value = (int16_t)climb;
+      int8_t speed_error = cruising ? 40 : 0;
+
+      arrival_t frame = { t + rand() % FRAME_JITTER_USEC, c_CID_A57_Audio,
+	  { (uint8_t)( value & 0xff), (uint8_t)( (uint16_t)value >> 8), 100, 0, 10, 0,
+	    (uint8_t)( cruising ? c_Cruising : 1), (uint8_t)( -speed_error) },
+	  ! cruising, paused };
+      frames.push_back( frame);
+      paused = false;
+
+      if( ++count % SIGNAL_EVERY == 0)
+	{
+	  arrival_t signal = { frame.usec + SIGNAL_DELAY_USEC, c_CID_A57_Signal, { 1, 50 }, false, false };
+	  frames.push_back( signal);
+	}
+    }
+  return frames;
+}
+
+static void receive( audio_logic_t &logic, const arrival_t &frame, uint32_t now_ms)
+{
+  if( frame.id == c_CID_A57_Audio)
+    logic.audio_frame( frame.data, now_ms);
+  else
+    logic.signal_frame( frame.data[0], frame.data[1], now_ms);
+}
+
+//! Audio_Controller's apply() calls set_frequency() for the vario voice
+static bool sets_frequency( const audio_output_t &out)
+{
+  return (out.frequency > 0) && (out.sweep_rate == 0) && ! out.sweeping;
+}
+
+//! the former loop: 10 ms grid, drain the queue, long sleep when silent
+static void run_polled( const std::vector <arrival_t> &frames, latencies &result)
+{
+  audio_logic_t logic;
+  uint64_t last_wake = 0, t = 0;
+  size_t next = 0;
+
+  while( next < frames.size())
+    {
+      last_wake += POLL_PERIOD_USEC; // vTaskDelayUntil(): no wait if already late
+      t = t > last_wake ? t : last_wake;
+      uint32_t now_ms = t / 1000;
+
+      std::vector <const arrival_t *> consumed;
+      unsigned queued = 0;
+      for( ; (next < frames.size()) && (frames[next].usec + WAKE_USEC <= t); ++next)
+	{
+	  if( ++queued > POLLED_QUEUE_SIZE)
+	    {
+	      ++result.lost;
+	      continue;
+	    }
+	  receive( logic, frames[next], now_ms);
+	  if( frames[next].vario)
+	    consumed.push_back( &frames[next]);
+	}
+      if( consumed.size() > 1)
+	result.superseded += consumed.size() - 1;
+
+      audio_output_t out = logic.run( now_ms);
+      t += LOOP_USEC;
+      if( sets_frequency( out))
+	for( const arrival_t *frame : consumed)
+	  result.add( *frame, t);
+
+      if( ! logic.is_vario_active ())
+	t += SILENT_DELAY_USEC;
+    }
+}
+
+//! Audio_Controller: one frame per pass, otherwise sleep until the logic's timeout
+static void run_event_driven( const std::vector <arrival_t> &frames, latencies &result)
+{
+  audio_logic_t logic;
+  uint64_t t = 0;
+  size_t next = 0;
+
+  while( next < frames.size())
+    {
+      uint32_t timeout = logic.timeout( t / 1000);
+      uint64_t deadline = timeout == AUDIO_LOGIC_NO_TIMEOUT ? NO_DEADLINE : (t / 1000 + timeout) * 1000;
+
+      uint64_t reception = frames[next].usec + WAKE_USEC;
+      bool received = reception <= deadline;
+      uint64_t wake = received ? reception : deadline;
+      t = t > wake ? t : wake;
+      uint32_t now_ms = t / 1000;
+
+      if( received)
+	receive( logic, frames[next], now_ms);
+      audio_output_t out = logic.run( now_ms);
+      t += LOOP_USEC;
+      if( received)
+	{
+	  if( frames[next].vario && sets_frequency( out))
+	    result.add( frames[next], t);
+	  ++next;
+	}
+    }
+}
+
+int main( void)
+{
+  std::vector <arrival_t> frames = make_stream();
+  printf( "%zu frames, %u us to reach the task, %u us per loop pass\n\n",
+	  frames.size(), WAKE_USEC, LOOP_USEC);
+
+  latencies polled, event_driven;
+  run_polled( frames, polled);
+  run_event_driven( frames, event_driven);
+
+  polled.report( "polled 10 ms");
+  printf( "\n");
+  event_driven.report( "event driven");
+  return 0;
+}
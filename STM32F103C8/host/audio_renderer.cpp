@@ -0,0 +1,443 @@
+/**
+ * @file    audio_renderer.cpp
+ * @brief   Offline audio renderer: CAN trace in, WAV file out (Linux host)
+ *
+ * Replays c_CID_A57_Audio and c_CID_A57_Signal frames from a candump log
+ * through the unmodified decision logic (src/audio_logic.h) and a clock
+ * accurate model of the sound output module (src/pieps.cpp, toggle mode):
+ * TIM2 toggle output with one voice per channel, chirp sweep, the TIM3 chopper
+ * gate forcing the vario channels low at its compare event and releasing
+ * them at its update event, attack / release envelope and the dithered
+ * open-drain loudness ladder.
+ * Voice routing, half periods, chirp, envelope and chopper timing are the
+ * headers pieps.cpp uses, only the timers and the ladder are modelled here.
+ * The model runs at the 24 MHz TIM2 count clock and is box-filtered
+ * down to the WAV sample rate.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -I../src -I../FreeRTOS/include -o audio_renderer
+ *       audio_renderer.cpp ../src/signal_sequencer.cpp
+ *   candump -L can0 > flight.log
+ *   ./audio_renderer flight.log flight.wav [-m]
+ *
+ * -m plays the power-up melody before the trace.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "Generic_CAN_Ids.h"
+#include "audio_logic.h"
+#include "envelope.h"
+#include "chirp_generator.h"
+#include "chopper_cadence.h"
+#include "voice_routing.h"
+#include "toggle_periods.h"
+#include "loudness_ladder.h"
+#include "pieps.h"
+
+#define MODEL_CLOCK		24000000 // TIM2 count clock in toggle mode
+#define MODEL_CLOCKS_PER_MS	(MODEL_CLOCK / 1000)
+#define CHOPPER_PRESCALE	2400	 // TIM3 @ 10 kHz
+#define CHOPPER_COUNTS_PER_MS	10
+#define MAX_CHOPPER_PERIOD_MS	(0xffff / CHOPPER_COUNTS_PER_MS)
+#define ENVELOPE_TICKS_PER_MS	(SIGNAL_PERIOD_BASE_VALUE * 2 / 1000)
+
+#define WAV_SAMPLE_RATE		48000
+#define CLOCKS_PER_SAMPLE	(MODEL_CLOCK / WAV_SAMPLE_RATE)
+#define TRAILER_MS		1500 // let the watchdog mute and the envelope release
+
+//! software model of pieps.cpp, toggle output variant
+class tone_model
+{
+public:
+  tone_model( void)
+  : counter( 0), ccr1( 12000), ccr2( 6000),
+    ch1( false), ch2( false), ch1_enabled( false), ch2_enabled( false),
+    gate_arr( 0xffff), gate_arr_preload( 0xffff), gate_ccr1( 0), gate_ccr1_preload( 0),
+    gate_counter( 0), gate_prescaler( 0), gate_forced( true), gate_is_open( true),
+    chopper_period_ms( 0), chopper_on_ms( 0), retune(), periods( retune), ladder_gain( 0.0)
+  {
+    for( unsigned code = 0; code < LOUDNESS_STEPS; ++code)
+      node_gain[code] = ladder_node_gain( code);
+
+    envelope.configure(
+	envelope_generator::slope( MAX_LOUDNESS_LEVEL, ATTACK_TIME_MS * ENVELOPE_TICKS_PER_MS),
+	envelope_generator::slope( MAX_LOUDNESS_LEVEL, RELEASE_TIME_MS * ENVELOPE_TICKS_PER_MS));
+  }
+
+  void set_frequency( uint16_t frequency_Hz, audio_voice_t voice)
+  {
+    if( frequency_Hz == 0)
+      return;
+    if( voice == VARIO_VOICE)
+      sweep.cancel();
+    periods.retune( voice, frequency_Hz);
+  }
+
+  void sweep_frequency( uint16_t start_Hz, uint16_t stop_Hz, uint32_t rate_Hz_per_s)
+  {
+    periods.cancel( VARIO_VOICE);
+    sweep.arm( start_Hz, stop_Hz, rate_Hz_per_s);
+    update_voices();
+  }
+
+  void set_volume( uint16_t volume, audio_voice_t voice)
+  {
+    routing.set_level( voice, ((uint32_t)volume * (MAX_LOUDNESS_LEVEL + 1)) >> 16);
+    update_voices();
+  }
+
+  void sound_on( bool activated, audio_voice_t voice)
+  {
+    routing.set_on( voice, activated);
+    update_voices();
+  }
+
+  void set_chopper( uint16_t period_ms, uint16_t on_ms)
+  {
+    chopper_timing( period_ms, on_ms, MAX_CHOPPER_PERIOD_MS);
+    if( (period_ms == chopper_period_ms) && (on_ms == chopper_on_ms))
+      return;
+
+    bool was_continuous = (chopper_period_ms == 0);
+    chopper_period_ms = period_ms;
+    chopper_on_ms = on_ms;
+
+    if( period_ms == 0)
+      {
+	gate_forced = true; // DMA requests off, CCMR1 = open image
+	gate_is_open = true;
+	return;
+      }
+    gate_arr_preload = period_ms * CHOPPER_COUNTS_PER_MS - 1;
+    gate_ccr1_preload = on_ms * CHOPPER_COUNTS_PER_MS;
+    if( was_continuous)
+      {
+	gate_counter = 0;
+	gate_prescaler = 0;
+	gate_arr = gate_arr_preload;
+	gate_ccr1 = gate_ccr1_preload;
+	gate_forced = false;
+	gate_is_open = true;
+      }
+  }
+
+  //! advance by one TIM2 count clock
+  void clock( void)
+  {
+    if( ++gate_prescaler == CHOPPER_PRESCALE)
+      {
+	gate_prescaler = 0;
+	if( gate_counter >= gate_arr)
+	  {
+	    gate_counter = 0;
+	    gate_arr = gate_arr_preload;
+	    gate_ccr1 = gate_ccr1_preload;
+	    if( ! gate_forced)
+	      gate_is_open = true; // update event: DMA writes the open image
+	  }
+	else if( (++gate_counter == gate_ccr1) && ! gate_forced)
+	  gate_is_open = false; // compare event: DMA writes the closed image
+      }
+
+    // forced inactive while the gate is closed, toggling from low again after
+    bool ch1_gated = ! gate_is_open && (routing.channel( 0) == VARIO_VOICE);
+    bool ch2_gated = ! gate_is_open && (routing.channel( 1) == VARIO_VOICE);
+    counter = (counter + 1) & 0xffff;
+    bool cc1 = counter == ccr1;
+    bool cc2 = counter == ccr2;
+    if( ch1_gated)
+      ch1 = false;
+    else if( cc1)
+      ch1 = ! ch1;
+    if( ch2_gated)
+      ch2 = false;
+    else if( cc2)
+      ch2 = ! ch2;
+    if( cc1 || cc2)
+      compare_interrupt( cc1, cc2);
+  }
+
+  //! voltage at the summing node, 1.0 = both tone pins high, ladder released
+  double output( void) const
+  {
+    return ladder_gain * ((ch1 && ch1_enabled ? 1.0 : 0.0) + (ch2 && ch2_enabled ? 1.0 : 0.0));
+  }
+
+private:
+  //! pieps.cpp update_voices(), the CC2 interrupt enable needs no model
+  void update_voices( void)
+  {
+    routing.update();
+    envelope.set_target( routing.target( gate_is_open));
+  }
+
+  //! volume dithering, averaged over the 16 slot pattern
+  void write_ladder( uint16_t level)
+  {
+    unsigned code = level >> 8;
+    unsigned fraction = (level >> 4) & 15;
+    ladder_gain = node_gain[code];
+    if( fraction)
+      ladder_gain += (node_gain[code + 1] - node_gain[code]) * fraction / 16.0;
+  }
+
+  //! TIM2_IRQHandler
+  void compare_interrupt( bool cc1, bool cc2)
+  {
+    bool one_voice = routing.channel( 0) == routing.channel( 1);
+    if( cc1)
+      {
+	uint32_t period = periods.next( routing.channel( 0), sweep);
+	ccr1 = (ccr1 + period) & 0xffff;
+	if( one_voice)
+	  ccr2 = (ccr1 - period / 2) & 0xffff;
+	envelope.set_target( routing.target( gate_is_open));
+	write_ladder( envelope.step( period));
+	ch1_enabled = ch2_enabled = ! envelope.is_idle();
+      }
+    if( cc2 && ! one_voice)
+      ccr2 = (ccr2 + periods.next( routing.channel( 1), sweep)) & 0xffff;
+  }
+
+  uint32_t counter, ccr1, ccr2;
+  bool ch1, ch2, ch1_enabled, ch2_enabled;
+
+  uint32_t gate_arr, gate_arr_preload, gate_ccr1, gate_ccr1_preload;
+  uint32_t gate_counter, gate_prescaler;
+  bool gate_forced;
+  bool gate_is_open;	//!< the image last written to TIM2->CCMR1
+  uint16_t chopper_period_ms, chopper_on_ms;
+
+  voice_routing routing;
+  retune_statistics_t retune;
+  toggle_periods periods;
+  envelope_generator envelope;
+  chirp_generator <ENVELOPE_TICKS_PER_MS> sweep;
+  double ladder_gain;
+  double node_gain[LOUDNESS_STEPS]; //!< summing node voltage per tone pin high
+};
+
+typedef struct
+{
+  uint32_t time_ms;
+  uint32_t id;
+  uint8_t dlc;
+  uint8_t data[8];
+} trace_frame_t;
+
+//! read "(1697040000.123456) can0 311#0011223344556677" lines
+static bool read_candump( const char *path, std::vector <trace_frame_t> &frames)
+{
+  FILE *file = fopen( path, "r");
+  if( file == 0)
+    return false;
+
+  char line[256];
+  double first_time = -1.0;
+  while( fgets( line, sizeof( line), file))
+    {
+      double time;
+      char interface[32];
+      char frame[64];
+      if( sscanf( line, " (%lf) %31s %63s", &time, interface, frame) != 3)
+	continue;
+
+      char *hash = strchr( frame, '#');
+      if( hash == 0 || hash[1] == 'R')
+	continue;
+      *hash = 0;
+
+      trace_frame_t f = { 0, (uint32_t)strtoul( frame, 0, 16), 0, { 0 } };
+      if( (f.id != c_CID_A57_Audio) && (f.id != c_CID_A57_Signal))
+	continue;
+
+      for( const char *hex = hash + 1; hex[0] && hex[1] && f.dlc < 8; hex += 2)
+	{
+	  char byte[3] = { hex[0], hex[1], 0 };
+	  f.data[f.dlc++] = (uint8_t)strtoul( byte, 0, 16);
+	}
+
+      if( first_time < 0.0)
+	first_time = time;
+      f.time_ms = (uint32_t)( (time - first_time) * 1000.0 + 0.5);
+      frames.push_back( f);
+    }
+  fclose( file);
+  return true;
+}
+
+static void write_le( FILE *file, uint32_t value, unsigned bytes)
+{
+  for( unsigned i = 0; i < bytes; ++i)
+    fputc( (value >> (8 * i)) & 0xff, file);
+}
+
+static bool write_wav( const char *path, const std::vector <int16_t> &samples)
+{
+  FILE *file = fopen( path, "wb");
+  if( file == 0)
+    return false;
+
+  uint32_t data_size = samples.size() * sizeof( int16_t);
+  fwrite( "RIFF", 1, 4, file);
+  write_le( file, 36 + data_size, 4);
+  fwrite( "WAVEfmt ", 1, 8, file);
+  write_le( file, 16, 4);
+  write_le( file, 1, 2); // PCM
+  write_le( file, 1, 2); // mono
+  write_le( file, WAV_SAMPLE_RATE, 4);
+  write_le( file, WAV_SAMPLE_RATE * sizeof( int16_t), 4);
+  write_le( file, sizeof( int16_t), 2);
+  write_le( file, 16, 2);
+  fwrite( "data", 1, 4, file);
+  write_le( file, data_size, 4);
+  for( int16_t sample : samples)
+    write_le( file, (uint16_t)sample, 2);
+  fclose( file);
+  return true;
+}
+
+//! Audio_Controller's apply()
+static void apply( tone_model &tone, const audio_output_t &out)
+{
+  tone.set_chopper( out.chopper_period_ms, out.chopper_on_ms);
+  if( out.frequency > 0)
+    {
+      if( out.sweep_rate != 0)
+	tone.sweep_frequency( out.frequency, out.sweep_stop, out.sweep_rate);
+      else if( ! out.sweeping)
+	tone.set_frequency( out.frequency, VARIO_VOICE);
+      tone.set_volume( step_volume( out.volume), VARIO_VOICE);
+      tone.sound_on( true, VARIO_VOICE);
+    }
+  else
+    tone.sound_on( false, VARIO_VOICE);
+
+  if( out.signal_frequency > 0)
+    {
+      tone.set_frequency( out.signal_frequency, SIGNAL_VOICE);
+      tone.set_volume( step_volume( out.signal_volume), SIGNAL_VOICE);
+      tone.sound_on( true, SIGNAL_VOICE);
+    }
+  else
+    tone.sound_on( false, SIGNAL_VOICE);
+}
+
+int main( int argc, char **argv)
+{
+  if( argc < 3)
+    {
+      fprintf( stderr, "usage: %s candump.log output.wav [-m]\n", argv[0]);
+      return 1;
+    }
+  bool play_startup_melody = (argc > 3) && (strcmp( argv[3], "-m") == 0);
+
+  std::vector <trace_frame_t> frames;
+  if( ! read_candump( argv[1], frames))
+    {
+      fprintf( stderr, "cannot read %s\n", argv[1]);
+      return 1;
+    }
+
+  uint32_t offset_ms = 0;
+  audio_logic_t logic;
+  tone_model tone;
+  if( play_startup_melody)
+    {
+      logic.start( 0);
+      for( const signal_note_t *note = startup_melody.notes; note->duration; ++note)
+	offset_ms += note->duration;
+    }
+  for( trace_frame_t &f : frames)
+    f.time_ms += offset_ms;
+
+  uint32_t end_ms = (frames.empty() ? offset_ms : frames.back().time_ms) + TRAILER_MS;
+  uint32_t wake_ms = play_startup_melody ? 0 : AUDIO_LOGIC_NO_TIMEOUT;
+  size_t next_frame = 0;
+
+  std::vector <int16_t> samples;
+  samples.reserve( (size_t)end_ms * WAV_SAMPLE_RATE / 1000);
+  double box = 0.0;
+  unsigned box_count = 0;
+  double previous_input = 0.0;
+  double previous_output = 0.0;
+
+  for( uint32_t now = 0; now < end_ms; ++now)
+    {
+      bool ran = false;
+      while( (next_frame < frames.size()) && (frames[next_frame].time_ms <= now))
+	{
+	  const trace_frame_t &f = frames[next_frame++];
+	  if( (f.id == c_CID_A57_Audio) && (f.dlc == 8))
+	    logic.audio_frame( f.data, now);
+	  else if( (f.id == c_CID_A57_Signal) && (f.dlc >= 1))
+	    logic.signal_frame( f.data[0], f.dlc >= 2 ? f.data[1] : 0, now);
+	  apply( tone, logic.run( now));
+	  ran = true;
+	}
+      if( ! ran && (wake_ms != AUDIO_LOGIC_NO_TIMEOUT) && ((int32_t)(now - wake_ms) >= 0))
+	{
+	  apply( tone, logic.run( now));
+	  ran = true;
+	}
+      if( ran)
+	{
+	  uint32_t timeout = logic.timeout( now);
+	  wake_ms = timeout == AUDIO_LOGIC_NO_TIMEOUT ? timeout : now + (timeout ? timeout : 1);
+	}
+
+      for( unsigned i = 0; i < MODEL_CLOCKS_PER_MS; ++i)
+	{
+	  tone.clock();
+	  box += tone.output();
+	  if( ++box_count == CLOCKS_PER_SAMPLE)
+	    {
+	      // average over one sample period, then the speaker coupling capacitor
+	      double input = box / CLOCKS_PER_SAMPLE;
+	      double output = input - previous_input + 0.995 * previous_output;
+	      previous_input = input;
+	      previous_output = output;
+	      box = 0.0;
+	      box_count = 0;
+
+	      int32_t sample = (int32_t)( output * 32767.0);
+	      if( sample > 32767)
+		sample = 32767;
+	      if( sample < -32768)
+		sample = -32768;
+	      samples.push_back( (int16_t)sample);
+	    }
+	}
+    }
+
+  if( ! write_wav( argv[2], samples))
+    {
+      fprintf( stderr, "cannot write %s\n", argv[2]);
+      return 1;
+    }
+  printf( "%u frames, %.1f s audio\n", (unsigned)frames.size(), end_ms / 1000.0);
+  return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file    dds_oscillator_test.cpp
+ * @brief   Wavetables and phase accumulator of dds_oscillator.h, plus cost per sample
+ *
+ * Checks against double precision references:
+ * - tables: peak 32767, sine table error against sin(), odd symmetry
+ * - frequency: the increment against the request, 100 Hz .. 8 kHz,
+ *   and the table periods counted over 10 s against the increment
+ * - retune: no sample step beyond the slope of the new frequency
+ * - clamp: requests at or above SAMPLE_RATE / 2
+ * - purity: SINAD of the sine at some audio frequencies from a DFT.
+ *   The phase truncated to 8 bits limits it to some 43 dB, frequencies
+ *   hitting whole table steps like 2500 Hz come out much cleaner.
+ * Then step() is timed on blocks of samples as the audio ISR does it.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -Wall -I../src -o dds_oscillator_test dds_oscillator_test.cpp
+ *   ./dds_oscillator_test
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <chrono>
+
+#include "dds_oscillator.h"
+
+#define SAMPLE_RATE		40000 // as pieps.cpp
+#define BLOCK_SAMPLES		40 // one ms per ISR block
+#define MIN_SINAD_DB		40.0
+
+typedef dds_oscillator<SAMPLE_RATE> oscillator_t;
+
+static bool pass = true;
+
+static void check( bool condition, const char *what)
+{
+  if( ! condition)
+    {
+      printf( "FAIL: %s\n", what);
+      pass = false;
+    }
+}
+
+static int table_peak( const int16_t *table)
+{
+  int peak = 0;
+  for( int i = 0; i < DDS_TABLE_SIZE; ++i)
+    if( abs( table[i]) > peak)
+      peak = abs( table[i]);
+  return peak;
+}
+
+static void tables( void)
+{
+  double worst = 0.0;
+  bool symmetric = true;
+  for( int i = 0; i < DDS_TABLE_SIZE; ++i)
+    {
+      double exact = 32767.0 * sin( 2.0 * M_PI * i / DDS_TABLE_SIZE);
+      double error = fabs( dds_sine_table.sample[i] - exact);
+      if( error > worst)
+	worst = error;
+      if( dds_sine_table.sample[(i + DDS_TABLE_SIZE / 2) % DDS_TABLE_SIZE] != -dds_sine_table.sample[i])
+	symmetric = false;
+    }
+  printf( "sine table: peak %d, max. error %.2f LSB, %s\n",
+	  table_peak( dds_sine_table.sample), worst, symmetric ? "odd symmetric" : "asymmetric");
+  check( table_peak( dds_sine_table.sample) == 32767, "sine table peak");
+  check( worst <= 0.5, "sine table error"); // rounding only
+  check( symmetric, "sine table symmetry");
+
+  printf( "timbre table: peak %d\n", table_peak( dds_timbre_table.sample));
+  check( table_peak( dds_timbre_table.sample) == 32767, "timbre table peak");
+}
+
+//! periods counted as wraps of the phase, seen as sign changes - to +
+static void frequency( void)
+{
+  static const uint16_t request[] = { 100, 440, 1000, 1234, 3000, 8000 };
+  const uint32_t seconds = 10;
+  double worst = 0.0;
+  bool counted = true;
+  for( uint16_t f : request)
+    {
+      oscillator_t osc;
+      osc.set_frequency( f);
+      double real = (double)osc.get_phase_increment() * SAMPLE_RATE / 4294967296.0;
+      uint32_t rising = 0;
+      int16_t last = osc.step();
+      for( uint32_t n = 1; n < seconds * SAMPLE_RATE; ++n)
+	{
+	  int16_t sample = osc.step();
+	  if( (last < 0) && (sample >= 0))
+	    ++rising;
+	  last = sample;
+	}
+      // the first period starts at phase 0, so the last one may be incomplete
+      uint32_t periods = (uint32_t)( real * seconds);
+      if( (rising != periods) && (rising + 1 != periods))
+	counted = false;
+      if( fabs( real - f) > worst)
+	worst = fabs( real - f);
+      printf( "%5u Hz: increment %9u = %10.4f Hz, %6u periods counted in %u s\n",
+	      f, osc.get_phase_increment(), real, rising, seconds);
+    }
+  check( worst < 0.02, "frequency"); // 2^32 / SAMPLE_RATE truncated
+  check( counted, "periods");
+}
+
+static void retune( void)
+{
+  oscillator_t osc;
+  osc.set_frequency( 500);
+  int16_t last = 0;
+  int worst_step = 0;
+  for( uint32_t n = 0; n < SAMPLE_RATE; ++n)
+    {
+      if( n % 997 == 0)
+	osc.set_frequency( n % 2 ? 2000 : 500); // mid-period, odd positions
+      int16_t sample = osc.step();
+      if( n > 0 && abs( sample - last) > worst_step)
+	worst_step = abs( sample - last);
+      last = sample;
+    }
+  // slope limit of 2 kHz plus one table step
+  int limit = (int)( 32767.0 * 2.0 * M_PI * 2000.0 / SAMPLE_RATE)
+      + (int)( 32767.0 * 2.0 * M_PI / DDS_TABLE_SIZE) + 1;
+  printf( "retune 500 <-> 2000 Hz: max. sample step %d, limit %d\n", worst_step, limit);
+  check( worst_step <= limit, "phase continuity");
+
+  osc.set_frequency( SAMPLE_RATE / 2);
+  check( osc.get_phase_increment() == (SAMPLE_RATE / 2 - 1) * oscillator_t::PHASE_INCREMENT_PER_HZ, "Nyquist clamp");
+  osc.set_frequency( 0xffff);
+  check( osc.get_phase_increment() == (SAMPLE_RATE / 2 - 1) * oscillator_t::PHASE_INCREMENT_PER_HZ, "clamp");
+  osc.set_frequency( 0);
+  int16_t held = osc.step();
+  check( osc.step() == held, "0 Hz holds the sample");
+}
+
+//! signal to noise and distortion from a DFT over a whole number of periods
+static double SINAD_dB( uint16_t f)
+{
+  const unsigned N = SAMPLE_RATE / 10; // 100 ms, 10 Hz bins
+  static double x[SAMPLE_RATE / 10];
+  oscillator_t osc;
+  osc.set_frequency( f);
+  double total = 0.0;
+  for( unsigned n = 0; n < N; ++n)
+    {
+      x[n] = osc.step();
+      total += x[n] * x[n];
+    }
+
+  // power of the fundamental bin, DC removed
+  unsigned bin = f / 10;
+  double re = 0.0, im = 0.0, mean = 0.0;
+  for( unsigned n = 0; n < N; ++n)
+    {
+      re += x[n] * cos( 2.0 * M_PI * bin * n / N);
+      im += x[n] * sin( 2.0 * M_PI * bin * n / N);
+      mean += x[n];
+    }
+  mean /= N;
+  double signal = 2.0 * (re * re + im * im) / N;
+  double rest = total - N * mean * mean - signal;
+  return 10.0 * log10( signal / rest);
+}
+
+static void purity( void)
+{
+  static const uint16_t request[] = { 440, 1000, 2500, 4000 };
+  for( uint16_t f : request)
+    {
+      double sinad = SINAD_dB( f);
+      printf( "%5u Hz: SINAD %5.1f dB\n", f, sinad);
+      check( sinad >= MIN_SINAD_DB, "SINAD");
+    }
+}
+
+static void benchmark( void)
+{
+  typedef std::chrono::steady_clock clock_type;
+  oscillator_t osc[2];
+  osc[0].set_frequency( 1000);
+  osc[1].set_frequency( 1234);
+  osc[1].set_waveform( dds_timbre_table.sample);
+  int16_t block[BLOCK_SAMPLES];
+  uint32_t blocks = 2000000;
+  int32_t checksum = 0;
+
+  clock_type::time_point start = clock_type::now();
+  for( uint32_t b = 0; b < blocks; ++b)
+    {
+      for( unsigned i = 0; i < BLOCK_SAMPLES; ++i)
+	block[i] = (osc[0].step() + osc[1].step()) >> 1;
+      checksum += block[b % BLOCK_SAMPLES];
+    }
+  double seconds = std::chrono::duration<double>( clock_type::now() - start).count();
+  printf( "two voices mixed: %.2f ns per sample, %.0f ns per %u sample block (checksum %d)\n",
+	  seconds * 1e9 / blocks / BLOCK_SAMPLES, seconds * 1e9 / blocks, BLOCK_SAMPLES, checksum);
+}
+
+int main( void)
+{
+  tables();
+  frequency();
+  retune();
+  purity();
+  benchmark();
+  printf( pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
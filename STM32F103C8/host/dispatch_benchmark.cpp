@@ -0,0 +1,160 @@
+/**
+ * @file    dispatch_benchmark.cpp
+ * @brief   Cost per frame: CAN_dispatch_index vs. the linear subscriber scan
+ *
+ * Both distribute the same ID stream to the same subscriber lists of
+ * growing length, "delivery" increments a counter per entry.
+ * The linear scan is the former distribute_CAN_packet(): one mask compare
+ * per entry and frame. All subscribers use exact IDs, one in eight
+ * shares its ID with another subscriber, one list also has two mask entries.
+ * Half of the frames carry an ID without any subscriber, as if the
+ * hardware filters had to accept everything.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -I../src -o dispatch_benchmark dispatch_benchmark.cpp
+ *   ./dispatch_benchmark [frames]
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+
+#include "CAN_dispatch.h"
+
+#define MAX_ENTRIES	128
+#define STREAM_LENGTH	4096
+
+typedef struct
+{
+  uint16_t ID_mask;
+  uint16_t ID_value;
+} entry_t;
+
+typedef std::chrono::steady_clock clock_type;
+
+static entry_t list[MAX_ENTRIES];
+static unsigned entries;
+static uint16_t stream[STREAM_LENGTH];
+static uint32_t delivered[MAX_ENTRIES];
+
+static uint16_t subscribed_ID( unsigned i)
+{
+  return 0x100 + (i & 7 ? i : i / 2) * 5; // every 8th ID taken twice
+}
+
+static void make_list( unsigned count, bool with_masks)
+{
+  entries = 0;
+  for( unsigned i = 0; i < count; ++i)
+    {
+      list[entries].ID_mask = 0xffff;
+      list[entries].ID_value = subscribed_ID( i);
+      ++entries;
+    }
+  if( with_masks)
+    {
+      list[entries].ID_mask = 0x7f0;
+      list[entries].ID_value = 0x400;
+      ++entries;
+      list[entries].ID_mask = 0x700;
+      list[entries].ID_value = 0x600;
+      ++entries;
+    }
+}
+
+static void make_stream( unsigned count)
+{
+  srand( 42);
+  for( unsigned i = 0; i < STREAM_LENGTH; ++i)
+    stream[i] = rand() & 1
+	? subscribed_ID( rand() % count)
+	: 0x700 + rand() % 0x100; // nobody listening
+}
+
+//! the former distribute_CAN_packet()
+static void linear_scan( uint16_t id)
+{
+  for( unsigned i = 0; i < entries; ++i)
+    if( (id & list[i].ID_mask) == list[i].ID_value)
+      ++delivered[i];
+}
+
+static CAN_dispatch_index<MAX_ENTRIES> dispatch;
+
+static void indexed( uint16_t id)
+{
+  for( uint8_t i = dispatch.first( id); i != dispatch.END; i = dispatch.next( i))
+    ++delivered[i];
+  for( unsigned k = 0; k < dispatch.get_masked_entries(); ++k)
+    {
+      unsigned i = dispatch.get_masked( k);
+      if( (id & list[i].ID_mask) == list[i].ID_value)
+	++delivered[i];
+    }
+}
+
+static uint64_t checksum( void)
+{
+  uint64_t sum = 0;
+  for( unsigned i = 0; i < MAX_ENTRIES; ++i)
+    {
+      sum = sum * 31 + delivered[i];
+      delivered[i] = 0;
+    }
+  return sum;
+}
+
+static double run( void (*distribute)( uint16_t), uint32_t frames)
+{
+  clock_type::time_point start = clock_type::now();
+  for( uint32_t n = 0; n < frames; n += STREAM_LENGTH)
+    for( unsigned i = 0; i < STREAM_LENGTH; ++i)
+      distribute( stream[i]);
+  std::chrono::duration<double> elapsed = clock_type::now() - start;
+  return elapsed.count() * 1e9 / frames;
+}
+
+int main( int argc, char *argv[])
+{
+  uint32_t frames = argc > 1 ? atoi( argv[1]) : 20000000;
+  static const unsigned sizes[] = { 4, 10, 16, 32, 64, 126 };
+
+  printf( "subscribers   linear ns/frame   indexed ns/frame\n");
+  for( int with_masks = 0; with_masks < 2; ++with_masks)
+    for( unsigned count : sizes)
+      {
+	make_list( count, with_masks);
+	make_stream( count);
+	dispatch.build( list, entries);
+
+	double linear = run( linear_scan, frames);
+	uint64_t expected = checksum();
+	double index = run( indexed, frames);
+	if( checksum() != expected)
+	  printf( "%u subscribers: different deliveries\n", entries);
+
+	printf( "%3u %-8s  %15.2f  %17.2f\n", entries, with_masks ? "+masks" : "",
+		linear, index);
+      }
+  return 0;
+}
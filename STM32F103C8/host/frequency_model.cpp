@@ -0,0 +1,167 @@
+/**
+ * @file    frequency_model.cpp
+ * @brief   Frequency mapping: accuracy and a Cortex-M3 cycle model
+ *
+ * Sweeps every frequency and compares timer_period() and chopper_period()
+ * against their formulas evaluated in double precision. Reported are the
+ * worst relative and absolute errors with the frequency where they occur.
+ * Above the vario range the integer ms of the short cadences dominate
+ * the chopper error, e.g. 2 % at 15 kHz.
+ *
+ * The cycle model counts Cortex-M3 cycles of the two divisions and of
+ * the interpolated table lookup that has been tried in their place
+ * (16 Hz steps, 2 Hz near the chopper pole).
+ * UDIV takes 2 .. 12 cycles, it terminates early depending on the
+ * significant bits of the quotient (modelled as 2 cycles + 1 per 4
+ * quotient bits). A table lookup is a fixed sequence of 1-cycle ALU
+ * instructions, one MUL and two LDRH (2 cycles each).
+ * Branches taken cost 3 cycles.
+ *
+ * Build and run (from this directory):
+ *   g++ -std=gnu++17 -O2 -Wall -Wextra -I../src -o frequency_model frequency_model.cpp
+ *   ./frequency_model
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "frequency_mapping.h"
+
+#define FIRST_TONE_FREQUENCY	300	// MINIMUM_FREQUENCY of the vario
+#define LAST_FREQUENCY		4577	// climb +32767 of c_CID_A57_Audio
+
+// Cortex-M3 cycle model
+#define ALU_CYCLES	1
+#define MUL_CYCLES	1
+#define LOAD_CYCLES	2
+#define BRANCH_CYCLES	3	// taken, not taken: 1
+
+#define TABLE_STEP_HZ		16	// the lookup tables that have been tried
+#define TABLE_DOMAIN_HZ		4096
+#define NEAR_TABLE_DOMAIN_HZ	512	// 2 Hz steps above CHOPPER_SHIFT
+
+static unsigned bits( uint32_t x)
+{
+  unsigned n = 0;
+  for( ; x; x >>= 1)
+    ++n;
+  return n;
+}
+
+static unsigned udiv_cycles( uint32_t dividend, uint32_t divisor)
+{
+  unsigned quotient_bits = bits( dividend / divisor);
+  unsigned cycles = 2 + (quotient_bits + 3) / 4;
+  return cycles > 12 ? 12 : cycles;
+}
+
+//! timer_period() and chopper_period(): rounding, UDIV, clamp each
+static unsigned division_cycles( uint16_t f)
+{
+  unsigned timer = 3 * ALU_CYCLES + udiv_cycles( SIGNAL_PERIOD_BASE_VALUE, f) + 2 * ALU_CYCLES;
+  unsigned chopper = 5 * ALU_CYCLES + udiv_cycles( CHOPPER_PERIOD * CHOPPER_TICK_MS, f - CHOPPER_SHIFT)
+      + 3 * ALU_CYCLES;
+  return timer + chopper;
+}
+
+//! interpolated table: CMP + branch, LSR, AND, 2 x LDRH, SUB, MUL, ASR, ADD
+static unsigned lookup_cycles( void)
+{
+  return 2 * ALU_CYCLES + 2 * ALU_CYCLES + 2 * LOAD_CYCLES + 3 * ALU_CYCLES + MUL_CYCLES + ALU_CYCLES;
+}
+
+static unsigned table_cycles( uint16_t f)
+{
+  unsigned timer = lookup_cycles();
+  // CMP + branch, SUB, CMP + branch to the near table, clamp
+  unsigned chopper = lookup_cycles() + 6 * ALU_CYCLES
+      + ((uint32_t)( f - CHOPPER_SHIFT) < NEAR_TABLE_DOMAIN_HZ ? 0 : BRANCH_CYCLES - 1);
+  return timer + chopper;
+}
+
+typedef struct
+{
+  double worst_relative;
+  double worst_absolute;
+  unsigned at_relative;
+  unsigned at_absolute;
+} error_t;
+
+static void account( error_t &e, unsigned f, double exact, double approximated)
+{
+  double absolute = fabs( approximated - exact);
+  double relative = absolute / exact;
+  if( relative > e.worst_relative)
+    {
+      e.worst_relative = relative;
+      e.at_relative = f;
+    }
+  if( absolute > e.worst_absolute)
+    {
+      e.worst_absolute = absolute;
+      e.at_absolute = f;
+    }
+}
+
+static void report( const char *name, const error_t &e, const char *unit)
+{
+  printf( "%-16s worst %.3f %% at %5u Hz, worst %.2f %s at %5u Hz\n",
+	  name, e.worst_relative * 100.0, e.at_relative, e.worst_absolute, unit, e.at_absolute);
+}
+
+int main( void)
+{
+  error_t timer = {}, chopper = {};
+  for( unsigned f = FIRST_TONE_FREQUENCY; f <= LAST_FREQUENCY; ++f)
+    {
+      account( timer, f, (double)SIGNAL_PERIOD_BASE_VALUE / f, timer_period( f));
+
+      double exact = ((double)CHOPPER_PERIOD / (f - CHOPPER_SHIFT) + 1.0) * CHOPPER_TICK_MS;
+      if( (f <= CHOPPER_SHIFT) || (exact > CHOPPER_CONTINUOUS_MS))
+	exact = CHOPPER_CONTINUOUS_MS;
+      account( chopper, f, exact, chopper_period( f));
+    }
+
+  printf( "accuracy against the formulas, %u .. %u Hz\n", FIRST_TONE_FREQUENCY, LAST_FREQUENCY);
+  report( "timer period", timer, "counts");
+  report( "chopper period", chopper, "ms");
+
+  // the former arithmetic needs f > CHOPPER_SHIFT
+  unsigned points = 0, division_sum = 0, division_max = 0, table_sum = 0, table_max = 0;
+  for( unsigned f = CHOPPER_SHIFT + 1; f < TABLE_DOMAIN_HZ; ++f)
+    {
+      unsigned d = division_cycles( f), t = table_cycles( f);
+      division_sum += d;
+      table_sum += t;
+      division_max = d > division_max ? d : division_max;
+      table_max = t > table_max ? t : table_max;
+      ++points;
+    }
+  printf( "\nCortex-M3 cycle model, timer + chopper period, %u .. %u Hz\n",
+	  CHOPPER_SHIFT + 1, TABLE_DOMAIN_HZ - 1);
+  printf( "division       mean %5.1f  max %3u cycles\n", (double)division_sum / points, division_max);
+  printf( "lookup table   mean %5.1f  max %3u cycles\n", (double)table_sum / points, table_max);
+  printf( "table flash    %u bytes\n",
+	  (unsigned)( sizeof( uint16_t) * (2 * (TABLE_DOMAIN_HZ / TABLE_STEP_HZ + 1) + NEAR_TABLE_DOMAIN_HZ / 2 + 1)));
+  return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file    spsc_benchmark.cpp
+ * @brief   Cost per frame: spsc_ring vs. the FreeRTOS Queue wrapper (Linux host)
+ *
+ * Moves 16 byte frames (sizeof CAN_packet) through Queue<> with
+ * send_from_ISR() / receive( NO_WAIT), as the CAN RX ISR and the
+ * distributor did, and through spsc_ring with push() / pop().
+ * The queue is the real one: FreeRTOS queue.c, tasks.c and list.c of
+ * this tree, compiled for the host with FreeRTOS_host/portmacro.h.
+ * There is no scheduler: both sides run in one thread, in bursts of
+ * 8 frames, nothing blocks. Critical sections and interrupt masking are
+ * empty here, on the target they add a few cycles per call to the queue.
+ *
+ * This measures the hop itself only. The wakeup of the receiving task
+ * (queue event list vs. task notification) and the context switch
+ * cannot run on this host port and are not part of the result.
+ * An earlier version compared two threads against a mutex / condition
+ * variable stand-in. That measured Linux futex wakeups, not FreeRTOS,
+ * and the ring lost there (~1050 vs. ~700 ns per frame).
+ * So the host result does not show an end-to-end gain of the rings with
+ * one wakeup per frame, only a cheaper hop: about 26 ns for the queue and
+ * 4.5 ns for the ring per frame here. The end-to-end figure needs a DWT
+ * cycle count on the target.
+ *
+ * Build and run (from this directory):
+ *   gcc -O2 -IFreeRTOS_host -I../FreeRTOS/include -I../src -o spsc_benchmark \
+ *     spsc_benchmark.cpp ../FreeRTOS/list.c ../FreeRTOS/queue.c ../FreeRTOS/tasks.c -lstdc++
+ *   ./spsc_benchmark [frames]
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <chrono>
+
+#include "FreeRTOS_wrapper.h"
+#include "spsc_ring.h"
+
+#define RING_SIZE	16 // as CAN_RX_RING_SIZE
+#define BURST		8
+
+typedef struct
+{
+  uint16_t id;
+  uint8_t dlc;
+  uint8_t is_remote;
+  uint32_t timestamp_usec;
+  uint64_t data;
+} frame_t;
+
+static_assert( sizeof( frame_t) == 16, "same size as CAN_packet");
+
+// what the kernel needs from the port and the application, never called here
+extern "C"
+{
+  void *pvPortMalloc( size_t size)
+  {
+    return malloc( size);
+  }
+  void vPortFree( void *p)
+  {
+    free( p);
+  }
+  StackType_t *pxPortInitialiseStack( StackType_t *top, TaskFunction_t, void *)
+  {
+    return top;
+  }
+  BaseType_t xPortStartScheduler( void)
+  {
+    return pdFALSE;
+  }
+  void vPortEndScheduler( void)
+  {}
+  void vApplicationIdleHook( void)
+  {}
+  void vApplicationTickHook( void)
+  {}
+  void vApplicationStackOverflowHook( TaskHandle_t, char *)
+  {}
+  uint64_t getTime_usec( void)
+  {
+    return 0;
+  }
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+static double seconds_since( clock_type::time_point start)
+{
+  return std::chrono::duration<double>( clock_type::now() - start).count();
+}
+
+static void report( const char *name, uint32_t frames, double seconds)
+{
+  printf( "%-24s %10.0f frames/s  %8.1f ns/frame\n",
+	  name, frames / seconds, seconds * 1e9 / frames);
+}
+
+static void run_queue( uint32_t frames)
+{
+  Queue<frame_t> queue( RING_SIZE);
+  frame_t f = { 0x311, 8, 0, 0, 0 };
+  uint64_t checksum = 0;
+
+  clock_type::time_point start = clock_type::now();
+  for( uint32_t n = 0; n < frames; n += BURST)
+    {
+      for( unsigned k = 0; k < BURST; ++k)
+	{
+	  f.data = n + k;
+	  queue.send_from_ISR( f);
+	}
+      for( unsigned k = 0; k < BURST; ++k)
+	{
+	  queue.receive( f, NO_WAIT);
+	  checksum += f.data;
+	}
+    }
+  report( "FreeRTOS Queue", frames, seconds_since( start));
+  if( checksum != (uint64_t)frames * (frames - 1) / 2)
+    printf( "FreeRTOS Queue: frames lost or reordered\n");
+}
+
+static void run_ring( uint32_t frames)
+{
+  spsc_ring<frame_t, RING_SIZE> ring;
+  frame_t f = { 0x311, 8, 0, 0, 0 };
+  uint64_t checksum = 0;
+
+  clock_type::time_point start = clock_type::now();
+  for( uint32_t n = 0; n < frames; n += BURST)
+    {
+      for( unsigned k = 0; k < BURST; ++k)
+	{
+	  f.data = n + k;
+	  ring.push( f);
+	}
+      for( unsigned k = 0; k < BURST; ++k)
+	{
+	  ring.pop( f);
+	  checksum += f.data;
+	}
+    }
+  report( "spsc_ring", frames, seconds_since( start));
+  if( checksum != (uint64_t)frames * (frames - 1) / 2)
+    printf( "spsc_ring: frames lost or reordered\n");
+}
+
+int main( int argc, char *argv[])
+{
+  uint32_t frames = argc > 1 ? atoi( argv[1]) : 20000000;
+  frames -= frames % BURST;
+  for( int round = 0; round < 3; ++round)
+    {
+      run_queue( frames);
+      run_ring( frames);
+    }
+  return 0;
+}
@@ -25,6 +25,54 @@
 #ifndef CAN_H_
 #define CAN_H_
 
+#include "CAN_filter.h"
+
+enum CAN_RX_fifo_t
+{
+  CAN_PRIORITY_FIFO,	//!< FIFO 0: priority subscriptions or everything if none
+  CAN_BULK_FIFO,	//!< FIFO 1: subscriptions without priority
+  CAN_RX_FIFOS
+};
+
+typedef struct
+{
+  uint32_t received;	//!< handed over to the consumer task
+  uint32_t dropped;	//!< ring full
+  uint32_t overruns;	//!< hardware FIFO overrun: the consumer has been too slow
+  uint32_t full;	//!< hardware FIFO filled up, all 3 entries in use
+  uint32_t high_water;	//!< max. frames waiting
+} CAN_RX_statistics_t;
+
+#define CAN_TX_PRIORITY_CLASSES	8 //!< ID bits 10..8, class 0 = highest priority
+
+typedef struct
+{
+  uint32_t sent;	//!< handed over to a TX mailbox
+  uint32_t dropped[CAN_TX_PRIORITY_CLASSES]; //!< rejected or pushed out of the TX queue
+  uint32_t high_water;	//!< max. frames waiting for a mailbox
+  uint32_t bits;	//!< on the wire, incl. stuff bits, see CAN_frame_bits()
+} CAN_TX_statistics_t;
+
+enum
+{
+  CAN_ERROR_WARNING = 1,	//!< TEC or REC >= 96
+  CAN_ERROR_PASSIVE = 2,	//!< TEC or REC > 127
+  CAN_BUS_OFF = 4		//!< TEC > 255
+};
+
+typedef struct
+{
+  uint8_t state;		//!< CAN_ERROR_WARNING | CAN_ERROR_PASSIVE | CAN_BUS_OFF
+  uint8_t TEC;			//!< transmit error counter
+  uint8_t REC;			//!< receive error counter
+  uint32_t bus_errors;		//!< stuff, form, ACK, bit and CRC errors seen
+  uint32_t warning_episodes;	//!< transitions into the states above
+  uint32_t passive_episodes;
+  uint32_t bus_off_episodes;
+} CAN_error_statistics_t;
+
+#define CAN_BIT_RATE	1000000 // 36 MHz APB1 / prescaler 4 / 9 time quanta
+
 //! basic CAN packet type
 class CAN_packet
 {
@@ -33,12 +81,14 @@ public:
 	: id(_id),
 	  dlc(_dlc),
 	  is_remote(_is_remote),
+	  timestamp_usec(0),
 	  data_l( data)
 	{}
 // attributes
 	uint16_t id; 		//!< identifier
 	uint8_t dlc; 		//!< data length code
 	uint8_t is_remote; 	//!< true for remote request
+	uint32_t timestamp_usec; //!< start of frame (bxCAN time stamp) in getTime_usec() units (wraps)
 	union
 	{
 	    uint8_t  data_b[8];   //!< data seen as 8 times uint8_t
@@ -64,10 +114,34 @@ public:
 //! CAN module initialization
 void CAN_init(void);
 
-//! CAN receive mechanism
-extern Queue < CAN_packet > CAN_RX_queue;
+//! CAN receive mechanism, one consumer task per FIFO
+bool CAN_receive( CAN_packet &p, CAN_RX_fifo_t fifo = CAN_PRIORITY_FIFO,
+		  unsigned ticks = INFINITE_WAIT);
+
+void CAN_get_RX_statistics( CAN_RX_fifo_t fifo, CAN_RX_statistics_t &s);
+
+/*! CAN send mechanism, frames are queued by ID priority
+ *
+ * If the queue is full, a frame of higher priority pushes out the
+ * queued frame of lowest priority, otherwise the caller may wait for space.
+ * Returns false if the frame has been dropped. */
+bool CAN_send( const CAN_packet &p, unsigned ticks = NO_WAIT);
+
+void CAN_get_TX_statistics( CAN_TX_statistics_t &s);
+
+//! error state and counters right now plus the episodes seen so far
+void CAN_get_error_statistics( CAN_error_statistics_t &s);
+
+//! bus-off handling, see CAN_recovery.h
+bool CAN_is_bus_off( void);
+void CAN_restart( void);
+bool CAN_reinitialize( void);
+void CAN_notify_on_bus_off( TaskHandle_t task);
+
+//! bus load and frame rates, called by the distribution tasks for each frame
+void CAN_statistics_count_RX( const CAN_packet &p);
 
-//! CAN send mechanism
-bool CAN_send( const CAN_packet &p);
+//! hardware acceptance filters, an empty plan accepts every frame
+void CAN_set_filters( const CAN_filter_plan &plan);
 
 #endif /* CAN_H_ */
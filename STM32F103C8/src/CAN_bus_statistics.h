@@ -0,0 +1,403 @@
+/***********************************************************************//**
+ * @file     	CAN_bus_statistics.h
+ * @brief    	Bus load and per-ID frame rates from the frames seen
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL dependency, no locking.
+ * The length of each frame on the wire is computed exactly: the CRC is
+ * calculated to count the stuff bits. CRC and stuff bits advance four
+ * bits per step from two constexpr tables (32 + 128 bytes), the bit
+ * serial form only handles the field ends. The busy bits of one window
+ * divided by the bits the window could carry give the bus load.
+ * The IDs of the window are counted in a small table using the
+ * space-saving scheme: a new ID replaces the entry with the fewest frames
+ * and inherits its count. Every ID with more than 1/CAN_TALKER_ENTRIES
+ * of the frames is guaranteed to be in the table, its counts may be too
+ * high by at most the inherited amount.
+ * The period statistics of one ID use the SOF time stamps of the frames,
+ * free of interrupt and task latencies.
+ *
+ **************************************************************************/
+
+#ifndef CAN_BUS_STATISTICS_H_
+#define CAN_BUS_STATISTICS_H_
+
+#include <stdint.h>
+#include "embedded_memory.h"
+
+#define CAN_TALKER_ENTRIES	16
+#define CAN_FRAME_TRAILER_BITS	13 // CRC delimiter, ACK slot + delimiter, EOF, intermission
+#define CAN_CRC15_POLYNOMIAL	0x4599
+
+//! CRC-15 of four bits, to be XORed after shifting the register by four
+class CAN_crc_nibble_table
+{
+public:
+  constexpr CAN_crc_nibble_table( void)
+  : crc()
+  {
+    for( unsigned nibble = 0; nibble < 16; ++nibble)
+      {
+	uint16_t c = nibble << 11;
+	for( unsigned k = 0; k < 4; ++k)
+	  c = ((c << 1) ^ (c & 0x4000 ? CAN_CRC15_POLYNOMIAL : 0)) & 0x7fff;
+	crc[nibble] = c;
+      }
+  }
+
+  uint16_t operator[]( unsigned nibble) const
+  {
+    return crc[nibble];
+  }
+
+private:
+  uint16_t crc[16];
+};
+
+/*! stuffing state after four bits: state = level << 2 | (run - 1)
+ *
+ * entry = stuff bits << 3 | next state */
+class CAN_stuff_nibble_table
+{
+public:
+  constexpr CAN_stuff_nibble_table( void)
+  : next()
+  {
+    for( unsigned state = 0; state < 8; ++state)
+      for( unsigned nibble = 0; nibble < 16; ++nibble)
+	{
+	  unsigned last = state >> 2;
+	  unsigned run = (state & 3) + 1;
+	  unsigned stuff = 0;
+	  for( unsigned k = 4; k-- > 0; )
+	    {
+	      unsigned bit = (nibble >> k) & 1;
+	      run = bit == last ? run + 1 : 1;
+	      last = bit;
+	      if( run == 5)
+		{
+		  ++stuff;
+		  last = ! bit;
+		  run = 1;
+		}
+	    }
+	  next[state][nibble] = (stuff << 3) | (last << 2) | (run - 1);
+	}
+  }
+
+  uint8_t operator()( unsigned state, unsigned nibble) const
+  {
+    return next[state][nibble];
+  }
+
+private:
+  uint8_t next[8][16];
+};
+
+CONSTEXPR_ROM CAN_crc_nibble_table CAN_CRC15_NIBBLE;
+CONSTEXPR_ROM CAN_stuff_nibble_table CAN_STUFF_NIBBLE;
+
+//! serializer counting the bits of a frame including stuff bits
+class CAN_wire_bits
+{
+public:
+  CAN_wire_bits( void)
+  : crc( 0),
+    bits( 0),
+    run( 0),
+    last( 2) // no level yet
+  {}
+
+  //! the n lower bits of value, MSB first
+  void put( uint32_t value, unsigned n, bool with_crc = true)
+  {
+    while( (n >= 4) && (last < 2))
+      {
+	n -= 4;
+	put_nibble( (value >> n) & 0xf, with_crc);
+      }
+    while( n-- > 0)
+      put_bit( (value >> n) & 1, with_crc);
+  }
+
+  uint16_t get_crc( void) const
+  {
+    return crc;
+  }
+  unsigned get_bits( void) const
+  {
+    return bits;
+  }
+
+private:
+  //! needs a level: not the first bit of the frame
+  void put_nibble( unsigned nibble, bool with_crc)
+  {
+    if( with_crc)
+      crc = ((crc << 4) ^ CAN_CRC15_NIBBLE[((crc >> 11) ^ nibble) & 0xf]) & 0x7fff;
+    unsigned next = CAN_STUFF_NIBBLE( (last << 2) | (run - 1), nibble);
+    bits += 4 + (next >> 3);
+    last = (next >> 2) & 1;
+    run = (next & 3) + 1;
+  }
+
+  void put_bit( unsigned bit, bool with_crc)
+  {
+    if( with_crc)
+      {
+	unsigned crc_next = bit ^ ((crc >> 14) & 1);
+	crc = (crc << 1) & 0x7fff;
+	if( crc_next)
+	  crc ^= CAN_CRC15_POLYNOMIAL;
+      }
+    ++bits;
+    if( bit == last)
+      ++run;
+    else
+      {
+	last = bit;
+	run = 1;
+      }
+    if( run == 5) // stuff bit of opposite level, starts the next run
+      {
+	++bits;
+	last = ! bit;
+	run = 1;
+      }
+  }
+
+  uint16_t crc;
+  unsigned bits;
+  unsigned run;
+  unsigned last;
+};
+
+/*! bits on the wire for a standard frame incl. stuff bits and intermission
+ *
+ * 47 .. 135 bits for DLC 0 .. 8 */
+static inline unsigned CAN_frame_bits( uint16_t id, uint8_t dlc, const uint8_t *data, bool remote)
+{
+  if( dlc > 8)
+    dlc = 8;
+
+  CAN_wire_bits wire;
+  wire.put( 0, 1);		// SOF
+  wire.put( id, 11);
+  wire.put( remote ? 1 : 0, 1);	// RTR
+  wire.put( 0, 2);		// IDE, r0
+  wire.put( dlc, 4);
+  if( ! remote)
+    for( unsigned k = 0; k < dlc; ++k)
+      wire.put( data[k], 8);
+  wire.put( wire.get_crc(), 15, false);
+
+  return wire.get_bits() + CAN_FRAME_TRAILER_BITS;
+}
+
+typedef struct
+{
+  uint16_t id;
+  uint16_t frames;
+  uint32_t bits;
+} CAN_talker_t;
+
+class CAN_bus_statistics
+{
+public:
+  CAN_bus_statistics( void)
+  {
+    restart();
+  }
+
+  //! one frame seen on the bus, received or sent
+  void count( uint16_t id, unsigned frame_bits)
+  {
+    ++frames;
+    bits += frame_bits;
+
+    unsigned smallest = 0;
+    for( unsigned i = 0; i < CAN_TALKER_ENTRIES; ++i)
+      {
+	if( talker[i].id == id)
+	  {
+	    add( talker[i], frame_bits);
+	    return;
+	  }
+	if( talker[i].frames < talker[smallest].frames)
+	  smallest = i;
+      }
+    talker[smallest].id = id; // a free entry has 0 frames
+    add( talker[smallest], frame_bits);
+  }
+
+  //! frames not to be listed per ID, e.g. the own transmissions
+  void add_unlisted( uint32_t more_frames, uint32_t more_bits)
+  {
+    frames += more_frames;
+    bits += more_bits;
+  }
+
+  uint32_t get_frames( void) const
+  {
+    return frames;
+  }
+  uint32_t get_bits( void) const
+  {
+    return bits;
+  }
+
+  //! bus load in 1/1000 for a window of window_usec at bit_rate
+  uint16_t get_load_permille( uint32_t window_usec, uint32_t bit_rate) const
+  {
+    return load_permille( bits, window_usec, bit_rate);
+  }
+
+  static uint16_t load_permille( uint32_t busy_bits, uint32_t window_usec, uint32_t bit_rate)
+  {
+    uint64_t capacity = (uint64_t)window_usec * bit_rate / 1000000;
+    if( capacity == 0)
+      return 0;
+    uint64_t load = (uint64_t)busy_bits * 1000 / capacity;
+    return load > 1000 ? 1000 : (uint16_t)load;
+  }
+
+  /*! the n IDs with most frames, in descending order
+   *
+   * returns the number of entries written, <= n */
+  unsigned get_top_talkers( CAN_talker_t *top, unsigned n) const
+  {
+    unsigned found = 0;
+    for( unsigned i = 0; i < CAN_TALKER_ENTRIES; ++i)
+      {
+	if( talker[i].frames == 0)
+	  continue;
+	unsigned k = found < n ? found++ : n;
+	while( (k > 0) && (top[k - 1].frames < talker[i].frames))
+	  {
+	    if( k < n)
+	      top[k] = top[k - 1];
+	    --k;
+	  }
+	if( k < n)
+	  top[k] = talker[i];
+      }
+    return found;
+  }
+
+  //! start a new window
+  void restart( void)
+  {
+    frames = 0;
+    bits = 0;
+    for( unsigned i = 0; i < CAN_TALKER_ENTRIES; ++i)
+      {
+	talker[i].id = 0xffff;
+	talker[i].frames = 0;
+	talker[i].bits = 0;
+      }
+  }
+
+private:
+  static void add( CAN_talker_t &t, unsigned frame_bits)
+  {
+    if( t.frames < 0xffff)
+      ++t.frames;
+    t.bits += frame_bits;
+  }
+
+  uint32_t frames;
+  uint32_t bits;
+  CAN_talker_t talker[CAN_TALKER_ENTRIES];
+};
+
+#define CAN_PERIOD_MAX_USEC	1000000 //!< longer: sender paused, not a period
+
+//! period and jitter of one periodic frame from its SOF time stamps
+class CAN_period_statistics
+{
+public:
+  CAN_period_statistics( void)
+  : seen( false),
+    last_usec( 0)
+  {
+    restart();
+  }
+
+  void add( uint32_t timestamp_usec)
+  {
+    uint32_t period = timestamp_usec - last_usec;
+    bool valid = seen && (period <= CAN_PERIOD_MAX_USEC);
+    seen = true;
+    last_usec = timestamp_usec;
+    if( ! valid)
+      return;
+
+    ++periods;
+    sum += period;
+    sum_of_squares += (uint64_t)period * period;
+  }
+
+  uint32_t get_periods( void) const
+  {
+    return periods;
+  }
+  uint32_t get_mean_usec( void) const
+  {
+    return periods ? sum / periods : 0;
+  }
+  //! standard deviation of the period
+  uint32_t get_jitter_usec( void) const
+  {
+    if( periods < 2)
+      return 0;
+    uint64_t n_variance = sum_of_squares - sum * sum / periods; // n * variance
+    return square_root( n_variance / periods);
+  }
+
+  //! start a new window, the next frame continues the period
+  void restart( void)
+  {
+    periods = 0;
+    sum = 0;
+    sum_of_squares = 0;
+  }
+
+private:
+  static uint32_t square_root( uint64_t x)
+  {
+    uint64_t root = 0;
+    for( uint64_t bit = (uint64_t)1 << 62; bit != 0; bit >>= 2)
+      if( x >= root + bit)
+	{
+	  x -= root + bit;
+	  root = (root >> 1) + bit;
+	}
+      else
+	root >>= 1;
+    return (uint32_t)root;
+  }
+
+  bool seen;
+  uint32_t last_usec;
+  uint32_t periods;
+  uint64_t sum;
+  uint64_t sum_of_squares;
+};
+
+#endif /* CAN_BUS_STATISTICS_H_ */
@@ -0,0 +1,142 @@
+/***********************************************************************//**
+ * @file     	CAN_dispatch.h
+ * @brief    	Constant time CAN ID -> subscriber lookup for the distributor
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL dependency, built from the subscription list
+ * whenever it changes.
+ * Exact 11 bit IDs are marked in a 2048 bit bitmap. The rank of an ID's
+ * bit (prefix count per word + popcount within the word) selects the
+ * head of a chain of subscribers to this ID, in subscription order.
+ * This costs 256 + 64 bytes instead of a 2048 entry table.
+ * Entries with a real mask are kept in a short list and compared as before.
+ * Entries are referenced by their index into the subscription list.
+ *
+ **************************************************************************/
+
+#ifndef CAN_DISPATCH_H_
+#define CAN_DISPATCH_H_
+
+#include <stdint.h>
+
+#define CAN_DISPATCH_IDS	2048
+#define CAN_DISPATCH_ID_MASK	(CAN_DISPATCH_IDS - 1)
+
+template <unsigned SIZE> class CAN_dispatch_index
+{
+  static_assert( SIZE < 256, "entries are addressed by uint8_t");
+public:
+  enum { END = 0xff };
+
+  CAN_dispatch_index( void)
+  : masked_entries( 0)
+  {
+    for( unsigned i = 0; i < WORDS; ++i)
+      bitmap[i] = prefix[i] = 0;
+  }
+
+  /*! rebuild from list[0 .. count-1]
+   *
+   * entry_type needs the members ID_mask and ID_value,
+   * an ID matches if (ID & ID_mask) == ID_value */
+  template <class entry_type> void build( const entry_type *list, unsigned count)
+  {
+    if( count > SIZE)
+      count = SIZE;
+
+    for( unsigned i = 0; i < WORDS; ++i)
+      bitmap[i] = 0;
+    masked_entries = 0;
+
+    for( unsigned i = 0; i < count; ++i)
+      if( is_exact( list[i]))
+	bitmap[list[i].ID_value >> 5] |= 1UL << (list[i].ID_value & 31);
+      else
+	masked[masked_entries++] = i;
+
+    uint8_t rank = 0;
+    for( unsigned i = 0; i < WORDS; ++i)
+      {
+	prefix[i] = rank;
+	rank += __builtin_popcount( bitmap[i]);
+      }
+
+    for( unsigned i = 0; i < SIZE; ++i)
+      head[i] = chain[i] = END;
+
+    // backwards: pushing to the front keeps the subscription order
+    for( unsigned i = count; i-- > 0; )
+      if( is_exact( list[i]))
+	{
+	  uint8_t r = rank_of( list[i].ID_value);
+	  chain[i] = head[r];
+	  head[r] = i;
+	}
+  }
+
+  //! first entry subscribed to exactly this ID, END if none
+  uint8_t first( uint16_t id) const
+  {
+    if( id > CAN_DISPATCH_ID_MASK)
+      return END;
+    if( (bitmap[id >> 5] & (1UL << (id & 31))) == 0)
+      return END;
+    return head[rank_of( id)];
+  }
+
+  //! next entry subscribed to the same ID, END if none
+  uint8_t next( uint8_t entry) const
+  {
+    return chain[entry];
+  }
+
+  //! entries with a real mask, to be compared by the caller
+  unsigned get_masked_entries( void) const
+  {
+    return masked_entries;
+  }
+  uint8_t get_masked( unsigned i) const
+  {
+    return masked[i];
+  }
+
+private:
+  enum { WORDS = CAN_DISPATCH_IDS / 32 };
+
+  template <class entry_type> static bool is_exact( const entry_type &entry)
+  {
+    return ((entry.ID_mask & CAN_DISPATCH_ID_MASK) == CAN_DISPATCH_ID_MASK)
+	&& (entry.ID_value <= CAN_DISPATCH_ID_MASK);
+  }
+
+  uint8_t rank_of( uint16_t id) const
+  {
+    uint32_t below = bitmap[id >> 5] & ((1UL << (id & 31)) - 1);
+    return prefix[id >> 5] + __builtin_popcount( below);
+  }
+
+  uint32_t bitmap[WORDS];	//!< bit set: exact subscription to this ID
+  uint8_t prefix[WORDS];	//!< bits set in all words below
+  uint8_t head[SIZE];		//!< per subscribed ID, by rank
+  uint8_t chain[SIZE];		//!< per entry
+  uint8_t masked[SIZE];
+  unsigned masked_entries;
+};
+
+#endif /* CAN_DISPATCH_H_ */
@@ -26,36 +26,112 @@
 #include "FreeRTOS_wrapper.h"
 #include "CAN.h"
 #include "CAN_distributor.h"
+#include "CAN_dispatch.h"
 
-#define CAN_LIST_SIZE 10
+#define CAN_LIST_SIZE 32
 
 CAN_distributor_entry CAN_distributor_list[CAN_LIST_SIZE];
+static unsigned CAN_distributor_entries;
+
+//! serializes the subscriptions: list, index and filter updates
+static Mutex CAN_subscription_lock( (char *)"CAN_SUB");
+
+/* Two copies: a subscription rebuilds the one not in use and then switches.
+ * Readers (the distribution tasks and local senders) count themselves in
+ * on the copy they use, a copy is only rebuilt after all of them have
+ * left it: a reader preempted during a lookup keeps a consistent index
+ * however many subscriptions follow.
+ * The counters are atomic (LDREX / STREX), no critical section per frame.
+ * A reader counts itself in and then checks that its copy is still the
+ * active one, otherwise it retries: either the rebuild sees the reader
+ * or the reader sees the switch. */
+static CAN_dispatch_index<CAN_LIST_SIZE> CAN_dispatch[2];
+static unsigned CAN_active_dispatch;		//!< index into CAN_dispatch
+static unsigned CAN_dispatch_readers[2];
+
+static void update_CAN_dispatch( void)
+{
+  unsigned spare = 1 - CAN_active_dispatch;
+  while( __atomic_load_n( &CAN_dispatch_readers[spare], __ATOMIC_SEQ_CST) != 0)
+    delay( 1); // a reader has been preempted on the spare copy
+
+  CAN_dispatch[spare].build( CAN_distributor_list, CAN_distributor_entries);
+
+  // release: the list and index stores before the switch
+  __atomic_store_n( &CAN_active_dispatch, spare, __ATOMIC_SEQ_CST);
+}
+
+//! count in on the active copy, returns its index
+static inline unsigned enter_CAN_dispatch( void)
+{
+  while( true)
+    {
+      unsigned copy = __atomic_load_n( &CAN_active_dispatch, __ATOMIC_ACQUIRE);
+      __atomic_add_fetch( &CAN_dispatch_readers[copy], 1, __ATOMIC_SEQ_CST);
+      if( __atomic_load_n( &CAN_active_dispatch, __ATOMIC_SEQ_CST) == copy)
+	return copy;
+      __atomic_sub_fetch( &CAN_dispatch_readers[copy], 1, __ATOMIC_RELEASE); // switched meanwhile
+    }
+}
+
+//! let the CAN hardware drop every frame nobody has subscribed to
+//! some 470 bytes, too big for the subscriber's stack, protected by CAN_subscription_lock
+static CAN_filter_plan plan;
+
+static void update_CAN_filters( void)
+{
+  plan.clear();
+#if ! CAN_BUS_LOAD_MONITOR // otherwise: accept all to see the whole traffic
+  // all patterns: after a bulk overflow the priority ones still get their banks
+  for( unsigned i=0; i<CAN_distributor_entries; ++i)
+    plan.add( CAN_distributor_list[i].ID_mask, CAN_distributor_list[i].ID_value,
+	      CAN_distributor_list[i].priority);
+#endif
+  CAN_set_filters( plan);
+}
 
 bool subscribe_CAN_messages( const CAN_distributor_entry &that)
 {
-  for( unsigned i=0; i<CAN_LIST_SIZE; ++i)
+  CAN_subscription_lock.lock();
+  bool room = CAN_distributor_entries < CAN_LIST_SIZE;
+  if( room)
     {
-      if( CAN_distributor_list[i].queue == 0) // queue == 0 means: entry = empty
-	{
-	  CAN_distributor_list[i]=that;
-	  return true;
-	}
+      CAN_distributor_list[CAN_distributor_entries++]=that;
+      update_CAN_dispatch();
+      update_CAN_filters();
     }
-  return false; // list already full
+  CAN_subscription_lock.release();
+  return room; // false: list already full
+}
+
+static inline void deliver_CAN_packet( const CAN_distributor_entry &entry, const CAN_packet &p)
+{
+  bool ok = entry.queue->send( p, NO_WAIT);
+//  ASSERT( ok); todo patch
 }
 
 static inline void distribute_CAN_packet(const CAN_packet &p)
 {
-  for(unsigned i=0; i<CAN_LIST_SIZE; ++i)
+  unsigned copy = enter_CAN_dispatch();
+
+  const CAN_dispatch_index<CAN_LIST_SIZE> &dispatch = CAN_dispatch[copy];
+
+  for( uint8_t i = dispatch.first( p.id); i != dispatch.END; i = dispatch.next( i))
+    deliver_CAN_packet( CAN_distributor_list[i], p);
+
+  for( unsigned k=0; k < dispatch.get_masked_entries(); ++k)
     {
-      if( CAN_distributor_list[i].queue ==0) // end of list
-	return;
-      if( (p.id & CAN_distributor_list[i].ID_mask) == CAN_distributor_list[i].ID_value)
-	{
-	bool ok = CAN_distributor_list[i].queue->send( p, NO_WAIT);
-//	ASSERT( ok); todo patch
-	}
+      const CAN_distributor_entry &entry = CAN_distributor_list[dispatch.get_masked( k)];
+      if( (p.id & entry.ID_mask) == entry.ID_value)
+	deliver_CAN_packet( entry, p);
     }
+
+  __atomic_sub_fetch( &CAN_dispatch_readers[copy], 1, __ATOMIC_RELEASE);
+}
+
+void distribute_local_CAN_packet( const CAN_packet &p)
+{
+  distribute_CAN_packet( p);
 }
 
 void CAN_RX_task_code (void*)
@@ -65,12 +141,27 @@ void CAN_RX_task_code (void*)
   CAN_packet p;
   while (1)
     {
-	  CAN_RX_queue.receive( p);
+	  CAN_receive( p, CAN_PRIORITY_FIFO);
+	  CAN_statistics_count_RX( p);
+	  distribute_CAN_packet(p);
+    }
+}
+
+//! FIFO 0 traffic preempts the distribution of bulk packets
+Task CAN_RX_task (CAN_RX_task_code, "CAN_RX", configMINIMAL_STACK_SIZE, 0, STANDARD_TASK_PRIORITY + 1);
+
+void CAN_RX_bulk_task_code (void*)
+{
+  CAN_packet p;
+  while (1)
+    {
+	  CAN_receive( p, CAN_BULK_FIFO);
+	  CAN_statistics_count_RX( p);
 	  distribute_CAN_packet(p);
     }
 }
 
-Task CAN_RX_task (CAN_RX_task_code, "CAN_RX");
+Task CAN_RX_bulk_task (CAN_RX_bulk_task_code, "CAN_BULK");
 
 #if RUN_CAN_DISTRIBUTION_TEST
 
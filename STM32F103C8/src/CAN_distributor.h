@@ -32,8 +32,12 @@ typedef struct
   uint16_t ID_mask;
   uint16_t ID_value;
   Queue <CAN_packet> * queue;
+  bool priority;	//!< via FIFO 0, use a queue of its own to keep these apart from bulk packets
 } CAN_distributor_entry;
 
 bool subscribe_CAN_messages( const CAN_distributor_entry &that);
 
+//! hand a packet produced on this board to the subscribers, no bus traffic
+void distribute_local_CAN_packet( const CAN_packet &p);
+
 #endif /* CAN_DISTRIBUTOR_H_ */
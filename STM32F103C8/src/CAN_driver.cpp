@@ -24,6 +24,10 @@
 
 #include "system_configuration.h"
 #include "CAN.h"
+#include "spsc_ring.h"
+#include "sorted_queue.h"
+#include "CAN_bus_statistics.h"
+#include "CAN_timestamp.h"
 
 #if ACTIVATE_CAN
 
@@ -54,12 +58,92 @@
 
 CAN_HandleTypeDef CanHandle;
 
-Queue < CAN_packet > CAN_RX_queue(10,"CAN_RX");
+#define CAN_RX_RING_SIZE 16
+
+/*! ISR -> consumer task without kernel critical sections,
+ * the ISR wakes the consumer by a task notification */
+static spsc_ring < CAN_packet, CAN_RX_RING_SIZE > CAN_RX_ring[CAN_RX_FIFOS];
+static TaskHandle_t volatile CAN_RX_consumer[CAN_RX_FIFOS];
+static uint32_t CAN_RX_overruns[CAN_RX_FIFOS];
+static uint32_t CAN_RX_full[CAN_RX_FIFOS];
+static CAN_error_statistics_t CAN_errors;
+static TaskHandle_t CAN_error_listener; //!< notified when the bus goes off
+
+// the bxCAN time stamp counts bit times, CAN_timestamp_mapper expects microseconds
+static_assert( CAN_BIT_RATE == 1000000, "CAN time stamp needs 1 Mbit/s");
+
+//! used by both RX interrupts, they share one priority
+static CAN_timestamp_mapper CAN_RX_time;
+
+/** @brief receive from one FIFO
+ *
+ * The first caller becomes the FIFO's consumer, it must stay the only one. */
+bool CAN_receive( CAN_packet &p, CAN_RX_fifo_t fifo, unsigned ticks)
+{
+  if( CAN_RX_consumer[fifo] == 0)
+    CAN_RX_consumer[fifo] = xTaskGetCurrentTaskHandle();
+  ASSERT( CAN_RX_consumer[fifo] == xTaskGetCurrentTaskHandle());
+
+  while( ! CAN_RX_ring[fifo].pop( p))
+    if( ulTaskNotifyTake( pdTRUE, ticks) == 0)
+      return CAN_RX_ring[fifo].pop( p); // timeout
+  return true;
+}
+
+void CAN_get_RX_statistics( CAN_RX_fifo_t fifo, CAN_RX_statistics_t &s)
+{
+  s.received = CAN_RX_ring[fifo].get_pushed();
+  s.dropped = CAN_RX_ring[fifo].get_dropped();
+  s.overruns = CAN_RX_overruns[fifo];
+  s.full = CAN_RX_full[fifo];
+  s.high_water = CAN_RX_ring[fifo].get_high_water();
+}
+
+//! ISR side: store the frame and wake the consumer
+static inline void CAN_RX_from_ISR( CAN_HandleTypeDef *hcan, CAN_RX_fifo_t fifo)
+{
+  CAN_packet p;
+  CAN_RxHeaderTypeDef header;
+  uint32_t now = (uint32_t)getTime_usec();
+  HAL_CAN_GetRxMessage( hcan, fifo == CAN_PRIORITY_FIFO ? CAN_RX_FIFO0 : CAN_RX_FIFO1,
+			&header, &(p.data_b[0]));
+  p.id=header.StdId;
+  p.dlc=header.DLC;
+  p.is_remote=header.RTR != 0 ? 1 : 0;
+  p.timestamp_usec = CAN_RX_time.SOF_time( header.Timestamp, now,
+					   p.is_remote ? 0 : (p.dlc > 8 ? 8 : p.dlc));
+
+  if( ! CAN_RX_ring[fifo].push( p))
+    return; // counted as dropped
+
+  TaskHandle_t consumer = CAN_RX_consumer[fifo];
+  if( consumer)
+    {
+      BaseType_t task_woken = pdFALSE;
+      vTaskNotifyGiveFromISR( consumer, &task_woken);
+      portEND_SWITCHING_ISR( task_woken);
+    }
+}
 
 void CAN_init (void);
 
-/** @brief Global CAN send function */
-bool CAN_send( const CAN_packet &p)
+#define CAN_TX_QUEUE_SIZE 16
+#define CAN_TX_MAILBOXES 3
+
+/*! frames waiting for a TX mailbox, highest priority first,
+ * accessed with the CAN interrupts masked */
+static sorted_queue < CAN_packet, CAN_TX_QUEUE_SIZE > CAN_TX_queue;
+static uint16_t CAN_TX_mailbox_id[CAN_TX_MAILBOXES];
+static CAN_TX_statistics_t CAN_TX_statistics;
+static Semaphore CAN_TX_space( 1, 0, (char *)"CAN_TX");
+
+static inline unsigned CAN_TX_priority_class( const CAN_packet &p)
+{
+  return (p.id >> 8) & (CAN_TX_PRIORITY_CLASSES - 1);
+}
+
+//! hand one frame to a free mailbox
+static bool CAN_TX_start( const CAN_packet &p)
 {
   CAN_TxHeaderTypeDef TxHeader;
   uint32_t TxMailbox;
@@ -71,10 +155,178 @@ bool CAN_send( const CAN_packet &p)
   TxHeader.DLC = p.dlc;
   TxHeader.TransmitGlobalTime = DISABLE;
 
-  return HAL_CAN_AddTxMessage (&CanHandle, &TxHeader, (uint8_t*) p.data_b, &TxMailbox) == HAL_OK;
+  if( HAL_CAN_AddTxMessage (&CanHandle, &TxHeader, (uint8_t*) p.data_b, &TxMailbox) != HAL_OK)
+    return false;
+
+  CAN_TX_mailbox_id[TxMailbox == CAN_TX_MAILBOX0 ? 0 : TxMailbox == CAN_TX_MAILBOX1 ? 1 : 2] = p.id;
+  ++CAN_TX_statistics.sent;
+  CAN_TX_statistics.bits += CAN_frame_bits( p.id, p.dlc, p.data_b, p.is_remote);
+  return true;
+}
+
+/*! true if a frame with this ID is still in a mailbox
+ *
+ * The mailboxes are sent by ID and then by mailbox number,
+ * a second frame with the same ID could overtake the first one. */
+static bool CAN_TX_ID_pending( uint16_t id)
+{
+  for( unsigned i = 0; i < CAN_TX_MAILBOXES; ++i)
+    if( ((CANx->TSR & (CAN_TSR_TME0 << i)) == 0) && (CAN_TX_mailbox_id[i] == id))
+      return true;
+  return false;
+}
+
+/*! move queued frames into free mailboxes, CAN interrupts masked
+ *
+ * returns true if space has been freed in the queue */
+static bool CAN_TX_refill( void)
+{
+  bool moved = false;
+  while( ! CAN_TX_queue.is_empty()
+      && (HAL_CAN_GetTxMailboxesFreeLevel( &CanHandle) > 0)
+      && ! CAN_TX_ID_pending( CAN_TX_queue.front().id)
+      && CAN_TX_start( CAN_TX_queue.front()))
+    {
+      CAN_TX_queue.pop_front();
+      moved = true;
+    }
+  return moved;
+}
+
+//! TX mailbox empty ISR side
+static inline void CAN_TX_done( void)
+{
+  if( CAN_TX_refill())
+    CAN_TX_space.signal_from_ISR();
+}
+
+/** @brief Global CAN send function
+ *
+ * @param ticks max. time to wait for space in the TX queue */
+bool CAN_send( const CAN_packet &p, unsigned ticks)
+{
+  TickType_t start = xTaskGetTickCount();
+  while( true)
+    {
+      taskENTER_CRITICAL();
+      bool queued = CAN_TX_queue.insert( p);
+      if( ! queued && (p < CAN_TX_queue.back()))
+	{
+	  ++CAN_TX_statistics.dropped[CAN_TX_priority_class( CAN_TX_queue.back())];
+	  CAN_TX_queue.pop_back();
+	  queued = CAN_TX_queue.insert( p);
+	}
+      if( queued)
+	{
+	  if( CAN_TX_queue.get_count() > CAN_TX_statistics.high_water)
+	    CAN_TX_statistics.high_water = CAN_TX_queue.get_count();
+	  CAN_TX_refill();
+	}
+      taskEXIT_CRITICAL();
+      if( queued)
+	return true;
+
+      TickType_t waited = xTaskGetTickCount() - start;
+      if( (ticks == NO_WAIT) || (waited >= ticks)
+	  || ! CAN_TX_space.wait( ticks == INFINITE_WAIT ? INFINITE_WAIT : ticks - waited))
+	break;
+    }
+
+  taskENTER_CRITICAL();
+  ++CAN_TX_statistics.dropped[CAN_TX_priority_class( p)];
+  taskEXIT_CRITICAL();
+  return false;
+}
+
+void CAN_get_TX_statistics( CAN_TX_statistics_t &s)
+{
+  taskENTER_CRITICAL();
+  s = CAN_TX_statistics;
+  taskEXIT_CRITICAL();
+}
+
+static uint8_t CAN_error_state( uint32_t ESR)
+{
+  return   (ESR & CAN_ESR_EWGF ? CAN_ERROR_WARNING : 0)
+	 | (ESR & CAN_ESR_EPVF ? CAN_ERROR_PASSIVE : 0)
+	 | (ESR & CAN_ESR_BOFF ? CAN_BUS_OFF : 0);
+}
+
+void CAN_get_error_statistics( CAN_error_statistics_t &s)
+{
+  taskENTER_CRITICAL();
+  s = CAN_errors;
+  taskEXIT_CRITICAL();
+
+  uint32_t ESR = CANx->ESR;
+  s.state = CAN_error_state( ESR);
+  s.TEC = (ESR & CAN_ESR_TEC) >> CAN_ESR_TEC_Pos;
+  s.REC = (ESR & CAN_ESR_REC) >> CAN_ESR_REC_Pos;
 }
 
 unsigned CAN_init_done( false);
+static bool CAN_running;
+
+static CAN_filter_bank_t filter_bank[CAN_FILTER_BANKS];
+static unsigned filter_banks; //!< 0 = accept every frame
+
+/** @brief write the stored filter plan into the bxCAN filter banks
+ *
+ * Mode, scale and FIFO can only change in filter init mode,
+ * reception pauses for these few microseconds. */
+static void program_filters( void)
+{
+  taskENTER_CRITICAL();
+  CANx->FMR |= CAN_FMR_FINIT;
+  CANx->FA1R = 0;
+
+  if( filter_banks == 0)
+    {
+      CANx->FS1R = 1; // bank 0: 32 bit mask, all don't care
+      CANx->FM1R = 0;
+      CANx->FFA1R = 0; // -> FIFO 0
+      CANx->sFilterRegister[0].FR1 = 0;
+      CANx->sFilterRegister[0].FR2 = 0;
+      CANx->FA1R = 1;
+    }
+  else
+    {
+      uint32_t list_mode = 0;
+      uint32_t fifo_1 = 0;
+      for( unsigned i = 0; i < filter_banks; ++i)
+	{
+	  if( filter_bank[i].list_mode)
+	    list_mode |= 1 << i;
+	  if( filter_bank[i].fifo)
+	    fifo_1 |= 1 << i;
+	  CANx->sFilterRegister[i].FR1 = filter_bank[i].FR1;
+	  CANx->sFilterRegister[i].FR2 = filter_bank[i].FR2;
+	}
+      CANx->FS1R = 0; // 16 bit scale
+      CANx->FM1R = list_mode;
+      CANx->FFA1R = fifo_1;
+      CANx->FA1R = (1 << filter_banks) - 1;
+    }
+
+  CANx->FMR &= ~CAN_FMR_FINIT;
+  taskEXIT_CRITICAL();
+}
+
+/** @brief take over a new filter plan
+ *
+ * May be called before CAN_init(), the plan is stored and programmed then. */
+void CAN_set_filters( const CAN_filter_plan &plan)
+{
+  taskENTER_CRITICAL();
+  filter_banks = plan.get_banks();
+  plan.compile( filter_bank);
+  taskEXIT_CRITICAL();
+
+  if( CAN_running)
+    program_filters();
+}
+
+static bool CAN_start_peripheral( void);
 
 /** @brief CAN driver initialization
  *
@@ -121,12 +373,17 @@ void CAN_init (void)
   HAL_NVIC_SetPriority (CAN1_SCE_IRQn, 15, 0);
   HAL_NVIC_EnableIRQ (CAN1_SCE_IRQn);
 
-  CAN_FilterTypeDef sFilterConfig;
+  if( ! CAN_start_peripheral())
+    Error_Handler ();
+}
 
+//! configure and start the bxCAN, at power-up and after a reset
+static bool CAN_start_peripheral( void)
+{
   /* Configure the CAN peripheral */
   CanHandle.Instance = CAN1;
 
-  CanHandle.Init.TimeTriggeredMode = DISABLE;
+  CanHandle.Init.TimeTriggeredMode = ENABLE; // RX time stamps
   CanHandle.Init.AutoBusOff = DISABLE;
   CanHandle.Init.AutoWakeUp = DISABLE;
   CanHandle.Init.AutoRetransmission = ENABLE;
@@ -139,38 +396,15 @@ void CAN_init (void)
   CanHandle.Init.Prescaler = 4;
 
   if (HAL_CAN_Init (&CanHandle) != HAL_OK)
-    {
-      /* Initialization Error */
-      Error_Handler ();
-    }
-
-  /* Configure the CAN Filter */
-  sFilterConfig.FilterBank = 0;
-  sFilterConfig.FilterMode = CAN_FILTERMODE_IDMASK;
-  sFilterConfig.FilterScale = CAN_FILTERSCALE_32BIT;
-  sFilterConfig.FilterIdHigh = 0x0000;
-  sFilterConfig.FilterIdLow = 0x0000;
-  sFilterConfig.FilterMaskIdHigh = 0x0000;
-  sFilterConfig.FilterMaskIdLow = 0x0000;
-  sFilterConfig.FilterFIFOAssignment = CAN_RX_FIFO0;
-  sFilterConfig.FilterActivation = ENABLE;
-  sFilterConfig.SlaveStartFilterBank = 14;
-
-  if (HAL_CAN_ConfigFilter (&CanHandle, &sFilterConfig) != HAL_OK)
-    {
-      /* Filter configuration Error */
-      Error_Handler ();
-    }
+    return false; /* Initialization Error */
 
-  /* Start the CAN peripheral */
-  if (HAL_CAN_Start (&CanHandle) != HAL_OK)
-    {
-      /* Start Error */
-      Error_Handler ();
-    }
+  /* Configure the CAN Filter: subscriptions made so far */
+  CAN_running = true;
+  program_filters();
 
   /* Activate CAN RX notification */
   if (HAL_CAN_ActivateNotification (&CanHandle,
+	CAN_IT_TX_MAILBOX_EMPTY     |
 	CAN_IT_RX_FIFO0_MSG_PENDING |
 	CAN_IT_RX_FIFO0_FULL        |
 	CAN_IT_RX_FIFO0_OVERRUN     |
@@ -183,10 +417,68 @@ void CAN_init (void)
 	CAN_IT_LAST_ERROR_CODE	    |
 	CAN_IT_ERROR		    )
       != HAL_OK)
-    {
-      /* Notification Error */
-      Error_Handler ();
-    }
+    return false; /* Notification Error */
+
+  /* Start the CAN peripheral, fails if the bus stays dominant */
+  CAN_RX_time.reset();
+  if (HAL_CAN_Start (&CanHandle) != HAL_OK)
+    return false; /* Start Error */
+
+  /* frames sent before */
+  taskENTER_CRITICAL();
+  CAN_TX_refill();
+  taskEXIT_CRITICAL();
+  return true;
+}
+
+//! true if bus-off or not (yet) synchronized to the bus
+bool CAN_is_bus_off( void)
+{
+  return ((CANx->ESR & CAN_ESR_BOFF) != 0)
+      || ((CANx->MSR & CAN_MSR_INAK) != 0)
+      || (CanHandle.State != HAL_CAN_STATE_LISTENING);
+}
+
+/** @brief leave bus-off: enter and leave initialization mode
+ *
+ * The bxCAN then waits for 128 x 11 recessive bits on its own. */
+void CAN_restart( void)
+{
+  CANx->MCR |= CAN_MCR_INRQ;
+  uint32_t start = (uint32_t)getTime_usec();
+  while( ((CANx->MSR & CAN_MSR_INAK) == 0) && ((uint32_t)getTime_usec() - start < 1000))
+    ;
+  CAN_RX_time.reset(); // time stamp counter restarts
+  CANx->MCR &= ~CAN_MCR_INRQ;
+}
+
+/** @brief reset the peripheral and start it again
+ *
+ * Frames waiting in the TX mailboxes are lost,
+ * the filters and the TX queue are taken over.
+ * Called by the supervisor task while the bus is off. */
+bool CAN_reinitialize( void)
+{
+  HAL_NVIC_DisableIRQ (USB_HP_CAN1_TX_IRQn);
+  HAL_NVIC_DisableIRQ (USB_LP_CAN1_RX0_IRQn);
+  HAL_NVIC_DisableIRQ (CAN1_RX1_IRQn);
+  HAL_NVIC_DisableIRQ (CAN1_SCE_IRQn);
+
+  CANx_FORCE_RESET();
+  CANx_RELEASE_RESET();
+  CAN_errors.state = 0;
+  bool started = CAN_start_peripheral();
+
+  HAL_NVIC_EnableIRQ (USB_HP_CAN1_TX_IRQn);
+  HAL_NVIC_EnableIRQ (USB_LP_CAN1_RX0_IRQn);
+  HAL_NVIC_EnableIRQ (CAN1_RX1_IRQn);
+  HAL_NVIC_EnableIRQ (CAN1_SCE_IRQn);
+  return started;
+}
+
+void CAN_notify_on_bus_off( TaskHandle_t task)
+{
+  CAN_error_listener = task;
 }
 
 
@@ -211,56 +503,95 @@ extern "C" void CAN1_SCE_IRQHandler( void)
 void
 HAL_CAN_ErrorCallback (CAN_HandleTypeDef *hcan)
 {
-//  asm("bkpt 0"); path ignored
+  if( hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV0)
+    ++CAN_RX_overruns[CAN_PRIORITY_FIFO];
+  if( hcan->ErrorCode & HAL_CAN_ERROR_RX_FOV1)
+    ++CAN_RX_overruns[CAN_BULK_FIFO];
+  if( hcan->ErrorCode & (HAL_CAN_ERROR_TX_ALST0 | HAL_CAN_ERROR_TX_TERR0 |
+			 HAL_CAN_ERROR_TX_ALST1 | HAL_CAN_ERROR_TX_TERR1 |
+			 HAL_CAN_ERROR_TX_ALST2 | HAL_CAN_ERROR_TX_TERR2))
+    CAN_TX_done(); // mailbox given up
+  if( hcan->ErrorCode & (HAL_CAN_ERROR_STF | HAL_CAN_ERROR_FOR | HAL_CAN_ERROR_ACK |
+			 HAL_CAN_ERROR_BR  | HAL_CAN_ERROR_BD  | HAL_CAN_ERROR_CRC))
+    ++CAN_errors.bus_errors;
+
+  // HAL reports a state again with every error while it lasts: count transitions
+  uint8_t state = CAN_error_state( hcan->Instance->ESR);
+  uint8_t entered = state & ~CAN_errors.state;
+  CAN_errors.state = state;
+  if( entered & CAN_ERROR_WARNING)
+    ++CAN_errors.warning_episodes;
+  if( entered & CAN_ERROR_PASSIVE)
+    ++CAN_errors.passive_episodes;
+  if( entered & CAN_BUS_OFF)
+    {
+      ++CAN_errors.bus_off_episodes;
+      if( CAN_error_listener)
+	{
+	  BaseType_t task_woken = pdFALSE;
+	  vTaskNotifyGiveFromISR( CAN_error_listener, &task_woken);
+	  portEND_SWITCHING_ISR( task_woken);
+	}
+    }
+//  asm("bkpt 0"); other paths ignored
+
+  HAL_CAN_ResetError( hcan); // HAL accumulates the codes otherwise
 }
 
 void
 HAL_CAN_TxMailbox0CompleteCallback (CAN_HandleTypeDef *hcan)
 {
-  asm("bkpt 0");
+  CAN_TX_done();
 }
 void
 HAL_CAN_TxMailbox1CompleteCallback (CAN_HandleTypeDef *hcan)
 {
-  asm("bkpt 0");
+  CAN_TX_done();
 }
 void
 HAL_CAN_TxMailbox2CompleteCallback (CAN_HandleTypeDef *hcan)
 {
-  asm("bkpt 0");
+  CAN_TX_done();
+}
+void
+HAL_CAN_TxMailbox0AbortCallback (CAN_HandleTypeDef *hcan)
+{
+  CAN_TX_done();
+}
+void
+HAL_CAN_TxMailbox1AbortCallback (CAN_HandleTypeDef *hcan)
+{
+  CAN_TX_done();
+}
+void
+HAL_CAN_TxMailbox2AbortCallback (CAN_HandleTypeDef *hcan)
+{
+  CAN_TX_done();
 }
 
 
 void
 HAL_CAN_RxFifo0MsgPendingCallback (CAN_HandleTypeDef *hcan)
 {
-  CAN_packet p;
-  CAN_RxHeaderTypeDef header;
-  HAL_CAN_GetRxMessage( hcan, 0, &header, &(p.data_b[0]));
-  p.id=header.StdId;
-  p.dlc=header.DLC;
-  p.is_remote=header.RTR != 0 ? 1 : 0;
-  bool result = CAN_RX_queue.send_from_ISR(p);
-  ASSERT( result);
+  CAN_RX_from_ISR( hcan, CAN_PRIORITY_FIFO);
 }
 
 void
 HAL_CAN_RxFifo0FullCallback (CAN_HandleTypeDef *hcan)
 {
-//  asm("bkpt 0"); // patch
+  ++CAN_RX_full[CAN_PRIORITY_FIFO];
+}
+
+void
+HAL_CAN_RxFifo1FullCallback (CAN_HandleTypeDef *hcan)
+{
+  ++CAN_RX_full[CAN_BULK_FIFO];
 }
 
 void
 HAL_CAN_RxFifo1MsgPendingCallback (CAN_HandleTypeDef *hcan)
 {
-  CAN_packet p;
-  CAN_RxHeaderTypeDef header;
-  HAL_CAN_GetRxMessage( hcan, 0, &header, &(p.data_b[0]));
-  p.id=header.StdId;
-  p.dlc=header.DLC;
-  p.is_remote=header.RTR != 0 ? 1 : 0;
-  bool result = CAN_RX_queue.send_from_ISR(p);
-  ASSERT( result);
+  CAN_RX_from_ISR( hcan, CAN_BULK_FIFO);
 }
 
 #endif
@@ -0,0 +1,260 @@
+/***********************************************************************//**
+ * @file     	CAN_filter.h
+ * @brief    	bxCAN acceptance filter banks compiled from ID subscriptions
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL dependency.
+ * Standard 11 bit IDs only, all banks in 16 bit scale:
+ * exact IDs go into ID-list banks (4 IDs each), ID/mask pairs into
+ * mask banks (2 pairs each). Register images follow the reference
+ * manual: STDID in bits 15..5, RTR bit 4, IDE bit 3.
+ * Data frames only: the list entries have RTR = 0 and the mask entries
+ * compare RTR and IDE, too.
+ * Priority subscriptions are assigned to FIFO 0, all others to FIFO 1.
+ * An empty plan means: accept every frame into FIFO 0.
+ *
+ * For a frame matching several filters the hardware takes a list filter
+ * before a mask filter and only then the lower bank number. A bulk ID
+ * covered by a priority ID/mask pair is therefore left out: as a list
+ * entry it would steal the frame from FIFO 0.
+ * When the banks run short the bulk patterns are replaced by one
+ * accept-all mask bank on FIFO 1 first, priority filtering goes last.
+ *
+ **************************************************************************/
+
+#ifndef CAN_FILTER_H_
+#define CAN_FILTER_H_
+
+#include <stdint.h>
+
+#define CAN_FILTER_BANKS	14 // STM32F103: single CAN, no slave banks
+#define CAN_STANDARD_ID_MASK	0x7ff
+
+//! one filter bank, register images for CAN_FxR1 and CAN_FxR2
+typedef struct
+{
+  bool list_mode;	//!< true: 4 IDs, false: 2 ID/mask pairs
+  uint8_t fifo;		//!< 0 = priority, 1 = bulk
+  uint32_t FR1;
+  uint32_t FR2;
+} CAN_filter_bank_t;
+
+class CAN_filter_plan
+{
+public:
+  CAN_filter_plan( void)
+  {}
+
+  //! start over without any pattern
+  void clear( void)
+  {
+    for( unsigned i = 0; i < GROUPS; ++i)
+      group[i].clear();
+  }
+
+  /*! ID matches if (ID & mask) == value
+   *
+   * false if the pattern's group has run out of banks: bulk frames are
+   * all accepted then, after a priority overflow every frame is.
+   * Further patterns may still be added in either case. */
+  bool add( uint16_t mask, uint16_t value, bool priority = false)
+  {
+    mask &= CAN_STANDARD_ID_MASK;
+    value &= mask;
+
+    if( priority)
+      {
+	if( mask != CAN_STANDARD_ID_MASK)
+	  group[BULK].remove_covered( mask, value);
+      }
+    else if( (mask == CAN_STANDARD_ID_MASK) && group[PRIORITY].covers( value))
+      return true; // arrives in FIFO 0 through the priority pair
+
+    group_t &g = group[priority ? PRIORITY : BULK];
+    if( ! g.add( mask, value))
+      g.overflow = true;
+
+    if( group[PRIORITY].banks() + bulk_banks() > CAN_FILTER_BANKS)
+      group[BULK].overflow = true; // one accept-all bank for the bulk frames
+    if( group[PRIORITY].banks() + bulk_banks() > CAN_FILTER_BANKS)
+      group[PRIORITY].overflow = true;
+    return ! g.overflow;
+  }
+
+  //! 0 = no filtering possible or wanted: accept everything
+  unsigned get_banks( void) const
+  {
+    if( group[PRIORITY].overflow)
+      return 0;
+    return group[PRIORITY].banks() + bulk_banks();
+  }
+
+  /*! register images, bank[] must hold get_banks() entries
+   *
+   * Priority banks come first, the lower bank number wins between
+   * mask filters. Too many bulk patterns are replaced by one
+   * accept-all bank on FIFO 1, priority list entries win against it. */
+  void compile( CAN_filter_bank_t *bank) const
+  {
+    if( get_banks() == 0)
+      return;
+
+    bank += group[PRIORITY].compile( bank, PRIORITY);
+    if( group[BULK].overflow)
+      {
+	bank->list_mode = false;
+	bank->fifo = BULK;
+	bank->FR1 = bank->FR2 = mask_image( 0) << 16;
+      }
+    else
+      group[BULK].compile( bank, BULK);
+  }
+
+private:
+  enum { PRIORITY, BULK, GROUPS };
+
+  typedef struct
+  {
+    uint16_t mask;
+    uint16_t value;
+  } pattern_t;
+
+  static uint16_t register_image( uint16_t id)
+  {
+    return id << 5; // RTR = IDE = 0
+  }
+
+  static uint16_t mask_image( uint16_t mask)
+  {
+    return (mask << 5) | 0x18; // RTR and IDE must match, too
+  }
+
+  unsigned bulk_banks( void) const
+  {
+    return group[BULK].overflow ? 1 : group[BULK].banks();
+  }
+
+  //! patterns for one receive FIFO
+  class group_t
+  {
+  public:
+    group_t( void)
+    : exact_IDs( 0),
+      masked_IDs( 0),
+      overflow( false)
+    {}
+
+    void clear( void)
+    {
+      exact_IDs = masked_IDs = 0;
+      overflow = false;
+    }
+
+    //! mask and value already reduced to standard IDs
+    bool add( uint16_t mask, uint16_t value)
+    {
+      if( overflow)
+	return false;
+
+      if( mask == CAN_STANDARD_ID_MASK)
+	{
+	  for( unsigned i = 0; i < exact_IDs; ++i)
+	    if( exact[i] == value)
+	      return true;
+	  if( exact_IDs >= 4 * CAN_FILTER_BANKS)
+	    return false;
+	  exact[exact_IDs++] = value;
+	}
+      else
+	{
+	  for( unsigned i = 0; i < masked_IDs; ++i)
+	    if( (masked[i].mask == mask) && (masked[i].value == value))
+	      return true;
+	  if( masked_IDs >= 2 * CAN_FILTER_BANKS)
+	    return false;
+	  masked[masked_IDs].mask = mask;
+	  masked[masked_IDs].value = value;
+	  ++masked_IDs;
+	}
+      return true;
+    }
+
+    //! id matches one of the ID/mask pairs
+    bool covers( uint16_t id) const
+    {
+      for( unsigned i = 0; i < masked_IDs; ++i)
+	if( (id & masked[i].mask) == masked[i].value)
+	  return true;
+      return false;
+    }
+
+    //! drop the exact IDs matching the ID/mask pair
+    void remove_covered( uint16_t mask, uint16_t value)
+    {
+      unsigned kept = 0;
+      for( unsigned i = 0; i < exact_IDs; ++i)
+	if( (exact[i] & mask) != value)
+	  exact[kept++] = exact[i];
+      exact_IDs = kept;
+    }
+
+    unsigned banks( void) const
+    {
+      return (exact_IDs + 3) / 4 + (masked_IDs + 1) / 2;
+    }
+
+    //! returns the number of banks written
+    unsigned compile( CAN_filter_bank_t *bank, uint8_t fifo) const
+    {
+      unsigned b = 0;
+      for( unsigned i = 0; i < exact_IDs; i += 4, ++b)
+	{
+	  // unused slots repeat the last ID of the bank
+	  uint16_t id[4];
+	  for( unsigned k = 0; k < 4; ++k)
+	    id[k] = register_image( exact[i + k < exact_IDs ? i + k : exact_IDs - 1]);
+	  bank[b].list_mode = true;
+	  bank[b].fifo = fifo;
+	  bank[b].FR1 = id[0] | ((uint32_t)id[1] << 16);
+	  bank[b].FR2 = id[2] | ((uint32_t)id[3] << 16);
+	}
+
+      for( unsigned i = 0; i < masked_IDs; i += 2, ++b)
+	{
+	  const pattern_t &first = masked[i];
+	  const pattern_t &second = masked[i + 1 < masked_IDs ? i + 1 : i];
+	  bank[b].list_mode = false;
+	  bank[b].fifo = fifo;
+	  bank[b].FR1 = register_image( first.value)  | ((uint32_t)mask_image( first.mask) << 16);
+	  bank[b].FR2 = register_image( second.value) | ((uint32_t)mask_image( second.mask) << 16);
+	}
+      return b;
+    }
+
+    uint16_t exact[4 * CAN_FILTER_BANKS];
+    pattern_t masked[2 * CAN_FILTER_BANKS];
+    unsigned exact_IDs;
+    unsigned masked_IDs;
+    bool overflow;
+  };
+
+  group_t group[GROUPS];
+};
+
+#endif /* CAN_FILTER_H_ */
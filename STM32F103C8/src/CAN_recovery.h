@@ -0,0 +1,194 @@
+/***********************************************************************//**
+ * @file     	CAN_recovery.h
+ * @brief    	Bus-off recovery: staged restarts with exponential backoff
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL or RTOS dependency, shared by the CAN
+ * supervisor task and the host model (host/CAN_recovery_model.cpp).
+ * Time is passed in as milliseconds (= RTOS ticks).
+ *
+ * With automatic bus-off management disabled the bxCAN stays bus-off
+ * until software toggles initialization mode, then it waits for
+ * 128 x 11 recessive bits before it takes part in the traffic again.
+ * The state machine waits a backoff time, requests such a restart and
+ * watches the bus-off flag. After CAN_RECOVERY_RESTARTS failed restarts
+ * the peripheral is reset and initialized again.
+ * Each failed attempt doubles the backoff. It is kept doubling across
+ * outages following each other within CAN_RECOVERY_STABLE_MS: a unit
+ * disturbing the bus repeatedly backs off further every time.
+ *
+ **************************************************************************/
+
+#ifndef CAN_RECOVERY_H_
+#define CAN_RECOVERY_H_
+
+#include <stdint.h>
+
+#define CAN_RECOVERY_FIRST_BACKOFF_MS	10
+#define CAN_RECOVERY_MAX_BACKOFF_MS	2000
+#define CAN_RECOVERY_ATTEMPT_MS		50	// 128 x 11 recessive bits = 1.4 ms at 1 Mbit/s + traffic
+#define CAN_RECOVERY_POLL_MS		1	// bxCAN signals no bus-off exit
+#define CAN_RECOVERY_RESTARTS		3	// then reinitialize the peripheral
+#define CAN_RECOVERY_STABLE_MS		10000	// error free: start over with the first backoff
+#define CAN_RECOVERY_NO_TIMEOUT		0xffffffff
+
+class CAN_bus_off_recovery
+{
+public:
+  enum state_t
+  {
+    ACTIVE,	//!< taking part in the traffic
+    BACKOFF,	//!< bus-off, waiting for the next attempt
+    RESTARTING	//!< bus-off, attempt running
+  };
+
+  enum action_t
+  {
+    NO_ACTION,
+    RESTART,		//!< enter and leave initialization mode
+    REINITIALIZE	//!< reset and initialize the peripheral
+  };
+
+  CAN_bus_off_recovery( void)
+  : state( ACTIVE),
+    backoff_ms( CAN_RECOVERY_FIRST_BACKOFF_MS),
+    deadline( 0),
+    outage_start( 0),
+    recovered_at( 0),
+    attempts( 0),
+    recoveries( 0),
+    last_recovery_ms( 0),
+    max_recovery_ms( 0)
+  {}
+
+  //! feed the bus-off flag, returns what to do with the peripheral
+  action_t update( bool bus_off, uint32_t now_ms)
+  {
+    switch( state)
+      {
+      case ACTIVE:
+	if( ! bus_off)
+	  return NO_ACTION;
+	if( (recoveries > 0) && (now_ms - recovered_at < CAN_RECOVERY_STABLE_MS))
+	  double_backoff();
+	else
+	  backoff_ms = CAN_RECOVERY_FIRST_BACKOFF_MS;
+	outage_start = now_ms;
+	attempts = 0;
+	enter( BACKOFF, now_ms + backoff_ms);
+	return NO_ACTION;
+
+      case BACKOFF:
+	if( expired( now_ms))
+	  {
+	    ++attempts;
+	    enter( RESTARTING, now_ms + CAN_RECOVERY_ATTEMPT_MS);
+	    return attempts > CAN_RECOVERY_RESTARTS ? REINITIALIZE : RESTART;
+	  }
+	return NO_ACTION;
+
+      case RESTARTING:
+	if( ! bus_off)
+	  {
+	    ++recoveries;
+	    last_recovery_ms = now_ms - outage_start;
+	    if( last_recovery_ms > max_recovery_ms)
+	      max_recovery_ms = last_recovery_ms;
+	    recovered_at = now_ms;
+	    state = ACTIVE;
+	  }
+	else if( expired( now_ms))
+	  {
+	    double_backoff();
+	    enter( BACKOFF, now_ms + backoff_ms);
+	  }
+	return NO_ACTION;
+      }
+    return NO_ACTION;
+  }
+
+  //! time until update() has work to do, CAN_RECOVERY_NO_TIMEOUT if active
+  uint32_t timeout( uint32_t now_ms) const
+  {
+    if( state == ACTIVE)
+      return CAN_RECOVERY_NO_TIMEOUT;
+    uint32_t left = expired( now_ms) ? 0 : deadline - now_ms;
+    if( (state == RESTARTING) && (left > CAN_RECOVERY_POLL_MS))
+      return CAN_RECOVERY_POLL_MS;
+    return left;
+  }
+
+  state_t get_state( void) const
+  {
+    return state;
+  }
+  bool is_outage( void) const
+  {
+    return state != ACTIVE;
+  }
+  uint32_t get_attempts( void) const //!< in the present or last outage
+  {
+    return attempts;
+  }
+  uint32_t get_recoveries( void) const
+  {
+    return recoveries;
+  }
+  uint32_t get_last_recovery_ms( void) const //!< bus-off detected -> active again
+  {
+    return last_recovery_ms;
+  }
+  uint32_t get_max_recovery_ms( void) const
+  {
+    return max_recovery_ms;
+  }
+  uint32_t get_backoff_ms( void) const
+  {
+    return backoff_ms;
+  }
+
+private:
+  void enter( state_t new_state, uint32_t new_deadline)
+  {
+    state = new_state;
+    deadline = new_deadline;
+  }
+
+  bool expired( uint32_t now_ms) const
+  {
+    return (int32_t)( now_ms - deadline) >= 0;
+  }
+
+  void double_backoff( void)
+  {
+    backoff_ms = backoff_ms * 2 > CAN_RECOVERY_MAX_BACKOFF_MS ? CAN_RECOVERY_MAX_BACKOFF_MS : backoff_ms * 2;
+  }
+
+  state_t state;
+  uint32_t backoff_ms;
+  uint32_t deadline;	//!< ms
+  uint32_t outage_start;	//!< ms
+  uint32_t recovered_at;	//!< ms
+  uint32_t attempts;
+  uint32_t recoveries;
+  uint32_t last_recovery_ms;
+  uint32_t max_recovery_ms;
+};
+
+#endif /* CAN_RECOVERY_H_ */
@@ -0,0 +1,176 @@
+/**
+ * @file    CAN_statistics.cpp
+ * @brief   CAN bus health and load, published on c_CID_AUD_CAN_Statistics
+ *
+ * The distribution tasks count every received frame, the TX path counts
+ * the bits sent by this unit. Once per CAN_STATISTICS_PERIOD_MS the
+ * window is evaluated and published as a sequence of pages:
+ *
+ * page 0:  uint8_t 0, uint8_t error state (CAN_ERROR_WARNING | ...),
+ *          uint8_t TEC, uint8_t REC,
+ *          uint16_t bus load / 1/1000, uint16_t frames / s
+ * page 1:  uint8_t 1, uint8_t error passive episodes,
+ *          uint16_t bus errors, uint16_t RX FIFO overruns,
+ *          uint16_t frames dropped (RX ring + TX queue)
+ * page 2+: uint8_t page, uint8_t 0, uint16_t ID,
+ *          uint16_t frames / s, uint16_t bus load / 1/1000
+ *          for the CAN_STATISTICS_TALKERS IDs received most often
+ * page 16: uint8_t 16, uint8_t 0, uint16_t CAN_PERIOD_MONITOR_ID,
+ *          uint16_t mean period / 0.1 ms, uint16_t period jitter (RMS) / us
+ *          period stability of the sensor box from the SOF time stamps,
+ *          sent if the ID has been received twice at least
+ *
+ * Counters are totals since power-up, saturated to the field size.
+ * Without CAN_BUS_LOAD_MONITOR only the subscribed IDs pass the
+ * hardware filters: load and rates cover these plus the own frames.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include "system_configuration.h"
+#include "FreeRTOS_wrapper.h"
+#include "Generic_CAN_Ids.h"
+#include "CAN.h"
+#include "CAN_bus_statistics.h"
+
+#if ACTIVATE_CAN
+
+#define CAN_STATISTICS_TALKERS	4
+#define CAN_PERIOD_PAGE		16
+#define CAN_PERIOD_MONITOR_ID	c_CID_KSB_Vario
+
+//! window since the last publication, updated by both distribution tasks
+static CAN_bus_statistics bus_statistics;
+static CAN_period_statistics period_statistics;
+
+void CAN_statistics_count_RX( const CAN_packet &p)
+{
+#if CAN_STATISTICS_PERIOD_MS
+  unsigned bits = CAN_frame_bits( p.id, p.dlc, p.data_b, p.is_remote);
+  taskENTER_CRITICAL();
+  bus_statistics.count( p.id, bits);
+  if( p.id == CAN_PERIOD_MONITOR_ID)
+    period_statistics.add( p.timestamp_usec);
+  taskEXIT_CRITICAL();
+#endif
+}
+
+#if CAN_STATISTICS_PERIOD_MS
+
+static inline uint16_t saturate( uint64_t x)
+{
+  return x > 0xffff ? 0xffff : x;
+}
+
+static inline uint16_t per_second( uint32_t count, uint32_t window_usec)
+{
+  return saturate( (uint64_t)count * 1000000 / window_usec);
+}
+
+static void publish( const CAN_bus_statistics &window, const CAN_period_statistics &period,
+		     uint32_t window_usec)
+{
+  CAN_error_statistics_t errors;
+  CAN_get_error_statistics( errors);
+  CAN_RX_statistics_t priority, bulk;
+  CAN_get_RX_statistics( CAN_PRIORITY_FIFO, priority);
+  CAN_get_RX_statistics( CAN_BULK_FIFO, bulk);
+  CAN_TX_statistics_t TX;
+  CAN_get_TX_statistics( TX);
+
+  uint32_t TX_dropped = 0;
+  for( unsigned i = 0; i < CAN_TX_PRIORITY_CLASSES; ++i)
+    TX_dropped += TX.dropped[i];
+
+  CAN_packet p( c_CID_AUD_CAN_Statistics, 8);
+  p.data_b[0] = 0;
+  p.data_b[1] = errors.state;
+  p.data_b[2] = errors.TEC;
+  p.data_b[3] = errors.REC;
+  p.data_h[2] = window.get_load_permille( window_usec, CAN_BIT_RATE);
+  p.data_h[3] = per_second( window.get_frames(), window_usec);
+  CAN_send( p);
+
+  p.data_b[0] = 1;
+  p.data_b[1] = errors.passive_episodes > 0xff ? 0xff : errors.passive_episodes;
+  p.data_h[1] = saturate( errors.bus_errors);
+  p.data_h[2] = saturate( (uint64_t)priority.overruns + bulk.overruns);
+  p.data_h[3] = saturate( (uint64_t)priority.dropped + bulk.dropped + TX_dropped);
+  CAN_send( p);
+
+  CAN_talker_t top[CAN_STATISTICS_TALKERS];
+  unsigned talkers = window.get_top_talkers( top, CAN_STATISTICS_TALKERS);
+  for( unsigned i = 0; i < talkers; ++i)
+    {
+      p.data_b[0] = 2 + i;
+      p.data_b[1] = 0;
+      p.data_h[1] = top[i].id;
+      p.data_h[2] = per_second( top[i].frames, window_usec);
+      p.data_h[3] = CAN_bus_statistics::load_permille( top[i].bits, window_usec, CAN_BIT_RATE);
+      CAN_send( p);
+    }
+
+  if( period.get_periods() > 0)
+    {
+      p.data_b[0] = CAN_PERIOD_PAGE;
+      p.data_b[1] = 0;
+      p.data_h[1] = CAN_PERIOD_MONITOR_ID;
+      p.data_h[2] = saturate( (period.get_mean_usec() + 50) / 100);
+      p.data_h[3] = saturate( period.get_jitter_usec());
+      CAN_send( p);
+    }
+}
+
+void CAN_statistics_runnable( void *)
+{
+  CAN_bus_statistics window;
+  CAN_period_statistics period;
+  CAN_TX_statistics_t TX;
+  CAN_get_TX_statistics( TX);
+  uint32_t last_TX_bits = TX.bits;
+  uint32_t last_TX_frames = TX.sent;
+  uint32_t window_start = (uint32_t)getTime_usec();
+
+  for( Synchronous_Timer t( CAN_STATISTICS_PERIOD_MS); true; )
+    {
+      t.sync();
+
+      taskENTER_CRITICAL();
+      window = bus_statistics;
+      bus_statistics.restart();
+      period = period_statistics;
+      period_statistics.restart();
+      taskEXIT_CRITICAL();
+
+      uint32_t now = (uint32_t)getTime_usec();
+      CAN_get_TX_statistics( TX);
+      window.add_unlisted( TX.sent - last_TX_frames, TX.bits - last_TX_bits);
+      publish( window, period, now - window_start);
+
+      window_start = now;
+      last_TX_bits = TX.bits;
+      last_TX_frames = TX.sent;
+    }
+}
+
+Task CAN_statistics_task( CAN_statistics_runnable, "CAN_STAT", 256);
+
+#endif
+#endif
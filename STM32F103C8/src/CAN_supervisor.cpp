@@ -0,0 +1,99 @@
+/**
+ * @file    CAN_supervisor.cpp
+ * @brief   Bus-off detection and recovery
+ *
+ * The CAN error interrupt wakes this task when the bxCAN goes bus-off,
+ * CAN_bus_off_recovery (CAN_recovery.h) decides when to restart or to
+ * reinitialize the peripheral.
+ * The start of an outage is signalled to the audio controller directly,
+ * it mutes the vario. After a recovery c_CID_AUD_CAN_Status is sent on
+ * the bus:
+ *
+ * uint8_t 1 = bus-off, 0 = active, uint8_t attempts of this outage,
+ * uint16_t recoveries, uint16_t time to recover / ms, uint16_t max. of it
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include "system_configuration.h"
+#include "FreeRTOS_wrapper.h"
+#include "Generic_CAN_Ids.h"
+#include "CAN.h"
+#include "CAN_recovery.h"
+#include "audio_controller.h"
+
+#if ACTIVATE_CAN
+
+static inline uint16_t saturate( uint32_t x)
+{
+  return x > 0xffff ? 0xffff : x;
+}
+
+static void report( const CAN_bus_off_recovery &recovery)
+{
+  CAN_packet p( c_CID_AUD_CAN_Status, 8);
+  p.data_b[0] = recovery.is_outage() ? 1 : 0;
+  p.data_b[1] = recovery.get_attempts() > 0xff ? 0xff : recovery.get_attempts();
+  p.data_h[1] = saturate( recovery.get_recoveries());
+  p.data_h[2] = saturate( recovery.get_last_recovery_ms());
+  p.data_h[3] = saturate( recovery.get_max_recovery_ms());
+
+  CAN_send( p);
+}
+
+void CAN_supervisor_runnable( void *)
+{
+  CAN_bus_off_recovery recovery;
+  CAN_notify_on_bus_off( xTaskGetCurrentTaskHandle());
+
+  while( true)
+    {
+      uint32_t timeout = recovery.timeout( xTaskGetTickCount());
+      (void) ulTaskNotifyTake( pdTRUE, timeout == CAN_RECOVERY_NO_TIMEOUT ? INFINITE_WAIT : timeout);
+
+      bool outage = recovery.is_outage();
+      switch( recovery.update( CAN_is_bus_off(), xTaskGetTickCount()))
+	{
+	case CAN_bus_off_recovery::RESTART:
+	  CAN_restart();
+	  break;
+	case CAN_bus_off_recovery::REINITIALIZE:
+	  (void) CAN_reinitialize(); // a failure keeps the bus "off"
+	  break;
+	default:
+	  break;
+	}
+
+      if( recovery.is_outage() == outage)
+	continue;
+      if( recovery.is_outage())
+	{
+#if RUN_AUDIO_CONTROLLER
+	  signal_CAN_outage();
+#endif
+	}
+      else
+	report( recovery);
+    }
+}
+
+Task CAN_supervisor( CAN_supervisor_runnable, "CAN_SUP", configMINIMAL_STACK_SIZE, 0, STANDARD_TASK_PRIORITY + 1);
+
+#endif
@@ -60,7 +60,7 @@ void CAN_RX_task_code (void*)
 
   while (1)
     {
-	  CAN_RX_queue.receive( dummy);
+	  CAN_receive( dummy);
 	  HAL_GPIO_WritePin( LED_PORT, LED_PIN, GPIO_PIN_SET);
 	  delay(50);
 	  HAL_GPIO_WritePin( LED_PORT, LED_PIN, GPIO_PIN_RESET);
@@ -0,0 +1,129 @@
+/***********************************************************************//**
+ * @file     	CAN_timestamp.h
+ * @brief    	bxCAN time-triggered capture -> getTime_usec() timebase
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL dependency.
+ * In time triggered mode the bxCAN latches its 16 bit bit-time counter
+ * at the sample point of the SOF bit of every frame received.
+ * At 1 Mbit/s one count is one microsecond. The counter is driven by
+ * the same crystal as SysTick: both timebases differ by a constant
+ * offset modulo 2^16 only, but the counter can not be read by software.
+ *
+ * The offset is learned from the frames: the RX interrupt runs at least
+ * CAN_SOF_TO_RX_IRQ_BITS after the SOF, plus interrupt latency and stuff
+ * bits. Every frame gives an observation of the offset that is too small
+ * by these delays; the largest observation seen is the best estimate.
+ * Jumps far beyond the delay variation are rejected once learned.
+ * At the end of each check window the offset drops to the best
+ * observation of the window, so a drift of the capture counter towards
+ * later times is followed as well. A window without any frame close to
+ * the minimum delay restarts learning, which removes an outlier caught
+ * while learning.
+ * The estimate must be reset whenever the bxCAN leaves initialization
+ * mode, the counter is restarted from zero then.
+ *
+ **************************************************************************/
+
+#ifndef CAN_TIMESTAMP_H_
+#define CAN_TIMESTAMP_H_
+
+#include <stdint.h>
+
+//! SOF .. CRC + CRC delimiter + ACK slot + delimiter + 6 EOF bits, no stuff bits
+#define CAN_SOF_TO_RX_IRQ_BITS( data_bytes)	(43 + 8 * (data_bytes))
+#define CAN_TIMESTAMP_LEARN_FRAMES	16	//!< accept any improvement before
+#define CAN_TIMESTAMP_MAX_STEP_USEC	200	//!< larger improvements are outliers
+#define CAN_TIMESTAMP_MAX_DELAY_USEC	5000	//!< SOF -> ISR, beyond: estimate wrong
+#define CAN_TIMESTAMP_CHECK_FRAMES	32	//!< window to verify the offset
+
+class CAN_timestamp_mapper
+{
+public:
+  CAN_timestamp_mapper( void)
+  {
+    reset();
+  }
+
+  //! forget the offset, e.g. after the bxCAN has left initialization mode
+  void reset( void)
+  {
+    frames = 0;
+    checked = 0;
+    window_excess = NO_EXCESS;
+  }
+
+  /*! start of frame in the timebase of now_usec
+   *
+   * @param capture bxCAN time stamp of the frame
+   * @param now_usec getTime_usec() in the RX interrupt
+   * @param data_bytes bytes on the wire, 0 for remote frames */
+  uint32_t SOF_time( uint16_t capture, uint32_t now_usec, unsigned data_bytes)
+  {
+    unsigned min_delay = CAN_SOF_TO_RX_IRQ_BITS( data_bytes);
+    uint16_t observation = (uint16_t)( capture - (uint16_t)now_usec + min_delay);
+
+    if( frames == 0)
+      offset = observation;
+    else
+      {
+	int16_t improvement = (int16_t)( observation - offset);
+	if( (improvement > 0)
+	    && ((frames < CAN_TIMESTAMP_LEARN_FRAMES) || (improvement <= CAN_TIMESTAMP_MAX_STEP_USEC)))
+	  offset = observation;
+      }
+    if( frames < CAN_TIMESTAMP_LEARN_FRAMES)
+      ++frames;
+
+    uint16_t delay = (uint16_t)( (uint16_t)now_usec + offset - capture);
+    int16_t excess = (int16_t)( delay - min_delay); // < 0: outlier rejected
+    bool plausible = (excess >= 0) && (delay <= CAN_TIMESTAMP_MAX_DELAY_USEC);
+
+    if( plausible && ((uint16_t)excess < window_excess))
+      window_excess = excess;
+    if( ++checked >= CAN_TIMESTAMP_CHECK_FRAMES)
+      {
+	if( window_excess > CAN_TIMESTAMP_MAX_STEP_USEC)
+	  {
+	    reset();
+	    return now_usec - min_delay;
+	  }
+	offset -= window_excess; // the best observation of the window
+	checked = 0;
+	window_excess = NO_EXCESS;
+      }
+
+    return plausible ? now_usec - delay : now_usec - min_delay;
+  }
+
+  bool is_learned( void) const
+  {
+    return frames >= CAN_TIMESTAMP_LEARN_FRAMES;
+  }
+
+private:
+  enum { NO_EXCESS = 0xffff };
+
+  uint16_t offset;	//!< capture - getTime_usec() at the SOF, modulo 2^16
+  uint16_t frames;	//!< observations since reset, saturated
+  uint16_t checked;	//!< frames in the present check window
+  uint16_t window_excess; //!< smallest delay beyond the minimum in the window
+};
+
+#endif /* CAN_TIMESTAMP_H_ */
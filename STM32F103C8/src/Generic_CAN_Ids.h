@@ -134,6 +134,26 @@
                                            //!< int16_t as float dec deg * 10    // Inclination
     c_CID_AUD_IAS_Offset       = 0x209,    //!< int16_t as float km/h * 10
 #endif
+    c_CID_AUD_Latency          = 0x220,    //!< uint16_t min, mean, p99, max / usec
+                                           //!< c_CID_A57_Audio: start of frame on the bus -> tone settings applied
+    c_CID_AUD_Baro_Vario       = 0x221,    //!< int16_t climb / mm/s +
+                                           //!< uint16_t max. measurement cycle / usec +
+                                           //!< uint16_t filter lag / ms +
+                                           //!< uint16_t end-to-end lag / ms
+    c_CID_AUD_Benchmark        = 0x222,    //!< uint8_t step + uint8_t page + 3 x uint16_t,
+                                           //!< see audio_benchmark.h
+    c_CID_AUD_CAN_Statistics   = 0x223,    //!< uint8_t page + 7 bytes bus health and load,
+                                           //!< see CAN_statistics.cpp
+    c_CID_AUD_CAN_Status       = 0x224,    //!< uint8_t bus-off + uint8_t attempts +
+                                           //!< uint16_t recoveries + 2 x uint16_t time to recover / ms,
+                                           //!< see CAN_supervisor.cpp
+
+    //
+    //  Commands addressed to AUD, from AD57 or a bench tool
+    //
+    c_CID_AUD_Tone_Profile_CMD = 0x230,    //!< uint8_t  command +
+                                           //!< parameters, see tone_profile.h
+    c_CID_AUD_Benchmark_CMD    = 0x231,    //!< empty package, starts the audio self-test
 
     //
     //  CAN packages with source AD57
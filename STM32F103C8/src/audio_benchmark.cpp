@@ -0,0 +1,155 @@
+/**
+ * @file    audio_benchmark.cpp
+ * @brief   Scripted audio self-test with timing measurements
+ *
+ * Each step programs the sound module, waits for the envelope
+ * and the chopper to settle and then lets the audio ISR collect
+ * its statistics for the step's duration.
+ * Expected values per step: the programmed frequency, the mean
+ * frequency of a sweep, one chopper period between gate openings.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include "main.h"
+#include "system_configuration.h"
+#include "Generic_CAN_Ids.h"
+#include "CAN.h"
+#include "embedded_memory.h"
+#include "pieps.h"
+#include "audio_benchmark.h"
+
+#if RUN_AUDIO_BENCHMARK
+
+#if ! RUN_AUDIO_CONTROLLER
+#error the audio benchmark runs within the audio controller task
+#endif
+
+#define CPU_CLOCK		72000000
+#define TONE_TIMER_COUNTS_PER_S	24000000
+#define SETTLE_MS		200 // envelope ramp + one chopper period
+
+typedef struct
+{
+  uint16_t frequency;		//!< vario voice / Hz, sweep start
+  uint8_t volume;		//!< loudness steps
+  uint16_t chopper_period_ms;	//!< 0 = continuous
+  uint16_t chopper_on_ms;
+  uint16_t sweep_stop;		//!< Hz, 0 = no sweep
+  uint16_t sweep_rate;		//!< Hz / s
+  uint16_t signal_frequency;	//!< Hz, 0 = vario voice only
+  uint16_t duration_ms;
+} benchmark_step_t;
+
+ROM benchmark_step_t script[] =
+{
+  {  400, 14,   0,  0,    0,    0,    0, 1000 },
+  { 1000,  7,   0,  0,    0,    0,    0, 1000 },
+  { 3000, 14,   0,  0,    0,    0,    0, 1000 },
+  { 4000,  1,   0,  0,    0,    0,    0, 1000 },
+  { 1000, 14, 400, 200,   0,    0,    0, 2000 },
+  { 1500, 14, 160,  60,   0,    0,    0, 2000 },
+  { 2500, 14,  80,  40,   0,    0,    0, 2000 },
+  {  500, 14,   0,  0, 3000, 2500,    0, 1000 }, // speed commander: up
+  { 3000, 14, 160, 60,  500, 1250,    0, 2000 }, // down, chopped
+  { 1000, 14, 400, 200,   0,    0, 2000, 2000 }, // vario + signal voice
+  { 1000, 14,   0,  0,    0,    0,  660, 1000 },
+};
+
+#define SCRIPT_STEPS (sizeof( script) / sizeof( benchmark_step_t))
+
+static inline uint16_t saturate( uint64_t value)
+{
+  return value > 0xffff ? 0xffff : value;
+}
+
+//!< program one step, returns the task time / DWT cycles
+static uint32_t apply_step( const benchmark_step_t &step)
+{
+  uint32_t start = DWT->CYCCNT;
+
+  set_chopper( step.chopper_period_ms, step.chopper_on_ms);
+  if( step.sweep_stop)
+    sweep_frequency( step.frequency, step.sweep_stop, step.sweep_rate);
+  else
+    set_frequency( step.frequency, VARIO_VOICE);
+  set_volume( step_volume( step.volume), VARIO_VOICE);
+  sound_on( true, VARIO_VOICE);
+
+  if( step.signal_frequency)
+    {
+      set_frequency( step.signal_frequency, SIGNAL_VOICE);
+      set_volume( step_volume( step.volume), SIGNAL_VOICE);
+    }
+  sound_on( step.signal_frequency != 0, SIGNAL_VOICE);
+
+  return DWT->CYCCNT - start;
+}
+
+static void report( uint8_t index, uint32_t task_cycles, uint32_t duration_ms,
+		    const audio_isr_statistics_t &isr)
+{
+  CAN_packet p( c_CID_AUD_Benchmark, 8);
+  p.data_b[0] = index;
+
+  p.data_b[1] = 0;
+  p.data_h[1] = isr.vario_counts == 0 ? 0 :
+      saturate( (uint64_t)TONE_TIMER_COUNTS_PER_S * 10 * isr.vario_half_periods / (2 * isr.vario_counts));
+  p.data_h[2] = saturate( (uint64_t)isr.max_latency * 1000000000 / TONE_TIMER_COUNTS_PER_S);
+  p.data_h[3] = isr.gate_openings < 2 ? 0 :
+      saturate( (uint64_t)(isr.max_gate_period - isr.min_gate_period) * 1000000 / CPU_CLOCK);
+  CAN_send( p);
+
+  p.data_b[1] = 1;
+  p.data_h[1] = saturate( (uint64_t)isr.cycles * 10000 / ((uint64_t)duration_ms * (CPU_CLOCK / 1000)));
+  p.data_h[2] = saturate( isr.max_cycles);
+  p.data_h[3] = saturate( task_cycles);
+  CAN_send( p);
+}
+
+void run_audio_benchmark( void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  audio_isr_statistics_t isr;
+  for( unsigned i = 0; i < SCRIPT_STEPS; ++i)
+    {
+      uint32_t task_cycles = apply_step( script[i]);
+      delay( SETTLE_MS);
+
+      audio_isr_snapshot( isr, true);
+      delay( script[i].duration_ms);
+      audio_isr_snapshot( isr, false);
+
+      report( i, task_cycles, script[i].duration_ms, isr);
+    }
+
+  sound_on( false, VARIO_VOICE);
+  sound_on( false, SIGNAL_VOICE);
+  set_chopper( 0, 0);
+
+  CAN_packet p( c_CID_AUD_Benchmark, 2);
+  p.data_b[0] = AUDIO_BENCHMARK_DONE;
+  p.data_b[1] = SCRIPT_STEPS;
+  CAN_send( p);
+}
+
+#endif
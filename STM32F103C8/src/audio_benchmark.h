@@ -0,0 +1,46 @@
+/**
+ * @file    audio_benchmark.h
+ * @brief   Scripted audio self-test with timing measurements
+ *
+ * Triggered by c_CID_AUD_Benchmark_CMD, run by the audio controller task.
+ * Refused while vario data is arriving: the script owns the sound module.
+ * Two c_CID_AUD_Benchmark frames per script step, byte 0 = step, byte 1 = page:
+ *
+ * page 0: uint16_t output frequency / 0.1 Hz (toggle mode, 0 = not measured),
+ *         uint16_t max. compare-to-ISR latency / ns,
+ *         uint16_t vario gate period jitter (max - min) / usec
+ * page 1: uint16_t audio ISR CPU load / 0.01 %,
+ *         uint16_t max. audio ISR time / cycles,
+ *         uint16_t task time to apply the step's settings / cycles
+ *
+ * A final frame with byte 0 = 0xff carries the number of steps in byte 1.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_BENCHMARK_H_
+#define AUDIO_BENCHMARK_H_
+
+#define AUDIO_BENCHMARK_DONE	0xff
+
+//! play the script and report, takes some 20 seconds
+void run_audio_benchmark( void);
+
+#endif /* AUDIO_BENCHMARK_H_ */
@@ -27,248 +27,219 @@
 #include "math.h"
 #include "Generic_CAN_Ids.h"
 #include "CAN_distributor.h"
+#include "audio_controller.h"
 #include "pieps.h"
+#include "audio_logic.h"
+#include "tone_profile.h"
+#include "latency_histogram.h"
+#include "local_vario.h"
+#include "audio_benchmark.h"
 
 #if RUN_AUDIO_CONTROLLER
 
-#define MINIMUM_FREQUENCY 300
-#define FREQUENCY_SHIFT 10
-#define CHOPPER_PERIOD 20000
-#define CHOPPER_SHIFT  500
+void
+Start_Audio (uint16_t vol, uint16_t freq);
 
-class chirp_controller_t
+//! hand the decision over to the sound output module
+static void
+apply (const audio_output_t &out)
 {
-public:
-  enum mode_type
-  {
-    STOPPED, DOWN, UP
-  };
-
-  chirp_controller_t (void)
-  {
-    instant_frequency = 0;
-    mode = STOPPED;
-  }
-
-  void
-  set_mode (mode_type mode, uint16_t speed_error = 0)
-  {
-    if (this->mode != mode)
-      {
-	switch (mode)
-	  {
-	  case UP:
-	    instant_frequency = START_F;
-	    increment = speed_error;
-	    break;
-	  case DOWN:
-	    instant_frequency = STOP_F;
-	    increment = speed_error;
-	    break;
-	  case STOPPED:
-	    increment = 0;
-	    instant_frequency = 0;
-	    break;
-	  }
-      }
-    this->mode = mode;
-  }
-
-  uint16_t step (void)
-  {
-    switch (mode)
-      {
-      case UP:
-	ASSERT( increment < 0);
-	instant_frequency -= increment;
-	if (instant_frequency > STOP_F)
-	  {
-	    instant_frequency = 0;
-	    mode = STOPPED;
-	  }
-	break;
-      case DOWN:
-	ASSERT( increment > 0);
-	instant_frequency -= increment >> 1;
-	if (instant_frequency < START_F)
-	  {
-	    instant_frequency = 0;
-	    mode = STOPPED;
-	  }
-	break;
-      case STOPPED:
-	instant_frequency = 0;
-	break;
-      }
-    return instant_frequency;
-  }
-private:
-  mode_type mode;
-  enum
-  {
-    START_F = 500, STOP_F = 3000, INCREMENT = 30
-  };
-  int16_t instant_frequency;
-  int16_t increment;
-};
+  set_chopper (out.chopper_period_ms, out.chopper_on_ms);
+  if (out.frequency > 0)
+    {
+      if (out.sweep_rate != 0)
+	sweep_frequency (out.frequency, out.sweep_stop, out.sweep_rate);
+      else if (! out.sweeping)
+	set_frequency (out.frequency, VARIO_VOICE);
+      set_volume (step_volume (out.volume), VARIO_VOICE);
+      sound_on (true, VARIO_VOICE);
+    }
+  else
+    sound_on (false, VARIO_VOICE);
 
-void
-Start_Audio (uint16_t vol, uint16_t freq);
+  if (out.signal_frequency > 0)
+    {
+      set_frequency (out.signal_frequency, SIGNAL_VOICE);
+      set_volume (step_volume (out.signal_volume), SIGNAL_VOICE);
+      sound_on (true, SIGNAL_VOICE);
+    }
+  else
+    sound_on (false, SIGNAL_VOICE);
+}
 
-enum
+#if REPORT_AUDIO_LATENCY
+
+#define LATENCY_REPORT_MS 1000
+
+//! c_CID_A57_Audio: start of frame on the bus -> settings applied, since power-up
+static latency_histogram audio_latency;
+
+static inline uint16_t
+saturate_usec (uint32_t usec)
 {
-  c_Cruising,         // 0
-  c_Transition,       // 1
-  c_Climbing,         // 2
-};
+  return usec > 0xffff ? 0xffff : usec;
+}
 
-typedef struct
+//! collect one sample, publish the statistics once per second
+static void
+report_latency (uint32_t latency_usec)
 {
-  uint16_t Signal_Id;
-  uint16_t Signal_Volume;
+  static uint32_t last_report;
 
-} SignalQItem_t;
+  audio_latency.add (latency_usec);
 
-ROM unsigned melody[] = {500, 630, 749, 1000, 1000};
+  uint32_t now = xTaskGetTickCount ();
+  if (now - last_report < LATENCY_REPORT_MS)
+    return;
+  last_report = now;
 
-void Audio_Controller (void *)
-{
-  uint8_t climbmode = 0;
-  uint16_t Interval = 0;
-  bool audio_muted = true;
-  uint16_t Audio_Volume = 0;
-  int Frequency;
-  int32_t NormedFrequency = 0.0;
+  CAN_packet p (c_CID_AUD_Latency, 8);
+  p.data_h[0] = saturate_usec (audio_latency.get_minimum ());
+  p.data_h[1] = saturate_usec (audio_latency.get_mean ());
+  p.data_h[2] = saturate_usec (audio_latency.get_percentile (990));
+  p.data_h[3] = saturate_usec (audio_latency.get_maximum ());
+  CAN_send (p);
+}
+
+#endif
+
+#if LOCAL_VARIO_FALLBACK
+#define RX_QUEUE_LENGTH		8
+#else
+#define RX_QUEUE_LENGTH		3
+#endif
+#define PRIORITY_QUEUE_LENGTH	3
+
+//! given by the CAN supervisor, member of the task's queue set
+static Semaphore CAN_outage_signal (1, 0, (char *) "OUTAGE");
 
-  int8_t speed_error = 0;
-  int16_t speed_error_integrator = 0;
-  chirp_controller_t chirp_controller;
-  unsigned interval_counter = 0;
+void
+signal_CAN_outage (void)
+{
+  CAN_outage_signal.signal ();
+}
 
-  Queue<CAN_packet> rx_q (3);
+void Audio_Controller (void *)
+{
+  audio_logic_t logic;
+#if LOCAL_VARIO_FALLBACK
+  local_vario_t local_vario;
+#endif
+  Queue<CAN_packet> rx_q (RX_QUEUE_LENGTH);
+  Queue<CAN_packet> priority_q (PRIORITY_QUEUE_LENGTH); // FIFO, ahead of everything else
+  Queue_set rx_set (RX_QUEUE_LENGTH + PRIORITY_QUEUE_LENGTH + 1);
+  rx_set.add (CAN_outage_signal);
+  rx_set.add (priority_q);
+  rx_set.add (rx_q);
 
     {
       CAN_distributor_entry cde =
-	{ 0xffff, c_CID_A57_Audio, &rx_q };
+	{ 0xffff, c_CID_A57_Audio, &priority_q, true };
       bool result = subscribe_CAN_messages (cde);
       ASSERT(result);
       cde.ID_value = c_CID_A57_Signal;
       result = subscribe_CAN_messages (cde);
       ASSERT(result);
+      cde.queue = &rx_q;
+      cde.priority = false;
+      cde.ID_value = c_CID_AUD_Tone_Profile_CMD;
+      result = subscribe_CAN_messages (cde);
+      ASSERT(result);
+#if RUN_AUDIO_BENCHMARK
+      cde.ID_value = c_CID_AUD_Benchmark_CMD;
+      result = subscribe_CAN_messages (cde);
+      ASSERT(result);
+#endif
+#if LOCAL_VARIO_FALLBACK
+      cde.ID_value = c_CID_KSB_Vario;
+      result = subscribe_CAN_messages (cde);
+      ASSERT(result);
+      cde.ID_value = c_CID_KSB_Airspeed;
+      result = subscribe_CAN_messages (cde);
+      ASSERT(result);
+      cde.ID_value = c_CID_KSB_Acceleration;
+      result = subscribe_CAN_messages (cde);
+      ASSERT(result);
+#if ACTIVATE_BARO_VARIO
+      cde.ID_value = c_CID_AUD_Baro_Vario;
+      result = subscribe_CAN_messages (cde);
+      ASSERT(result);
+#endif
+#endif
     }
 
   init_pieps ();
   sound_on (false);
 
-  delay(1000);
-  sound_on ( true);
-  set_volume (8192 * 3);
-
-  for( unsigned i=0; i < sizeof(melody)/sizeof(unsigned); ++i)
-    {
-	Frequency = melody[i];
-	set_frequency (Frequency);
-	delay(333);
-    }
-  sound_on ( false);
-
-  delay(2000);
+  init_tone_profile ();
+  logic.set_tone_curve (active_tone_curve ());
 
-  int CAN_RX_active = 0;
+  logic.start (xTaskGetTickCount ());
 
   // task main loop ************************************************
-  for (Synchronous_Timer t (10); true; t.sync ())
+  while (true)
     {
+      uint32_t timeout = logic.timeout (xTaskGetTickCount ());
+
       CAN_packet p;
-      while (rx_q.receive (p, NO_WAIT)) // receive CAN packet if available
+      bool audio_frame_received = false;
+      // wake up on packet arrival or outage, one select = one item in one member
+      QueueSetMemberHandle_t member = rx_set.select (timeout == AUDIO_LOGIC_NO_TIMEOUT ? INFINITE_WAIT : timeout);
+      if (member == CAN_outage_signal.get_semaphore ())
+	{
+	  (void) CAN_outage_signal.wait (NO_WAIT);
+	  logic.CAN_outage ();
+	}
+      else if (member && (priority_q.receive (p, NO_WAIT) || rx_q.receive (p, NO_WAIT)))
 	{
 	  if ((p.id == c_CID_A57_Audio) && (p.dlc == 8))
 	    {
-	      CAN_RX_active = 100;
-	      NormedFrequency = p.data_sh[0] + 10000;
-	      if (NormedFrequency < 0)
-		NormedFrequency = 0;
-	      Interval = p.data_h[1];
-	      Audio_Volume = p.data_b[4];
-	      climbmode = p.data_b[6];
-	      speed_error = -(int8_t) (p.data_sb[7]);
+	      logic.audio_frame (p.data_b, xTaskGetTickCount ());
+	      audio_frame_received = true;
+#if LOCAL_VARIO_FALLBACK
+	      local_vario.A57_frame (p.data_b, xTaskGetTickCount ());
+#endif
 	    }
-	}
-
-      if (CAN_RX_active) // kind of a watchdog
-	--CAN_RX_active;
-
-      if (CAN_RX_active == 0)
-	{
-	  Audio_Volume = 0;
-	  set_volume (Audio_Volume);
-	  sound_on (false);
-	  delay (100);
-	  continue; // continue polling CAN reception
-	}
-
-      if (Audio_Volume > 0)
-	{
-	  if (climbmode != c_Cruising) // ** VARIO ** sound
+	  else if ((p.id == c_CID_A57_Signal) && (p.dlc >= 1))
+	    logic.signal_frame (p.data_b[0], p.dlc >= 2 ? p.data_b[1] : 0,
+				xTaskGetTickCount ());
+	  else if (p.id == c_CID_AUD_Tone_Profile_CMD)
 	    {
-	      Frequency = MINIMUM_FREQUENCY + NormedFrequency / FREQUENCY_SHIFT;
-
-	      unsigned chopper = CHOPPER_PERIOD / (Frequency - CHOPPER_SHIFT);
-
-	      if (Interval > 10)
-		{
-		  ++interval_counter;
-		  if (interval_counter > chopper)
-		    interval_counter = 0;
-		  if (interval_counter > chopper / 2)
-		    Frequency = 0;
-		}
+	      if (tone_profile_command (p, ! logic.is_vario_active ())) // no flash stall in flight
+		logic.set_tone_curve (active_tone_curve ());
 	    }
-
-	  else   // ** SPEED COMMANDER **  sound
+#if RUN_AUDIO_BENCHMARK
+	  else if ((p.id == c_CID_AUD_Benchmark_CMD) && ! logic.is_vario_active ())
+	    run_audio_benchmark (); // frames arriving meanwhile are dropped
+#endif
+#if LOCAL_VARIO_FALLBACK
+	  else if ((p.id == c_CID_KSB_Vario) && (p.dlc >= 2))
 	    {
-	      speed_error_integrator += speed_error;
-	      if (speed_error_integrator > 1000)
-		{
-		  chirp_controller.set_mode (chirp_controller_t::DOWN,
-					     speed_error);
-		  speed_error_integrator = 0;
-		}
-	      else if (speed_error_integrator < -1000)
-		{
-		  chirp_controller.set_mode (chirp_controller_t::UP,
-					     speed_error);
-		  speed_error_integrator = 0;
-		}
-
-	      Frequency = chirp_controller.step ();
-
-	      if (speed_error > 0)
-		{
-		  ++interval_counter;
-		  if (interval_counter > 15)
-		    interval_counter = 0;
-		  if (interval_counter > 5)
-		    Frequency = 0;
-		}
-
+	      uint8_t frame[8];
+	      if (local_vario.vario_frame (p.data_b, xTaskGetTickCount (), frame))
+		logic.audio_frame (frame, xTaskGetTickCount ());
 	    }
-
-	  if( Frequency > 0)
+	  else if ((p.id == c_CID_KSB_Airspeed) && (p.dlc >= 4))
+	    local_vario.airspeed_frame (p.data_b, xTaskGetTickCount ());
+	  else if ((p.id == c_CID_KSB_Acceleration) && (p.dlc >= 7))
+	    local_vario.acceleration_frame (p.data_b, xTaskGetTickCount ());
+#if ACTIVATE_BARO_VARIO
+	  else if (p.id == c_CID_AUD_Baro_Vario)
 	    {
-		set_frequency (Frequency);
-		set_volume (Audio_Volume);
-		sound_on (true);
+	      uint8_t frame[8];
+	      if (local_vario.baro_frame (p.data_b, xTaskGetTickCount (), frame))
+		logic.audio_frame (frame, xTaskGetTickCount ());
 	    }
-	  else
-		sound_on (false);
-	} // volume > 0
-      else
-	{
-	    Frequency = 0;
-	    Audio_Volume = 0;
-	    sound_on (false);
+#endif
+#endif
 	}
+
+      apply (logic.run (xTaskGetTickCount ()));
+
+#if REPORT_AUDIO_LATENCY
+      if (audio_frame_received)
+	report_latency ((uint32_t) getTime_usec () - p.timestamp_usec);
+#endif
     } // task loop
 } // task
 
@@ -0,0 +1,31 @@
+/**
+ * @file    audio_controller.h
+ * @brief   Signals into the audio controller task
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIO_CONTROLLER_H_
+#define AUDIO_CONTROLLER_H_
+
+//! the CAN bus went off: mute the vario now, from task context
+void signal_CAN_outage( void);
+
+#endif /* AUDIO_CONTROLLER_H_ */
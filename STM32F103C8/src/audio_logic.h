@@ -0,0 +1,399 @@
+/***********************************************************************//**
+ * @file     	audio_logic.h
+ * @brief    	Decision logic of the audio controller: CAN input -> tone
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL or RTOS dependency, shared by the
+ * Audio_Controller task and the host renderer (host/audio_renderer.cpp).
+ * Time is passed in as milliseconds (= RTOS ticks).
+ *
+ **************************************************************************/
+
+#ifndef AUDIO_LOGIC_H_
+#define AUDIO_LOGIC_H_
+
+#include <stdint.h>
+#include "my_assert.h"
+#include "signal_sequencer.h"
+#include "frequency_mapping.h"
+#include "tone_curve.h"
+
+#define MINIMUM_FREQUENCY 300
+#define FREQUENCY_SHIFT 10
+
+#define SPEED_CHOPPER_PERIOD_MS 160
+#define SPEED_CHOPPER_ON_MS	60
+
+#define AUDIO_TICK_MS		10	// grid for the speed-commander
+#define CAN_RX_TIMEOUT_MS	1000	// mute if c_CID_A57_Audio stays missing
+#define AUDIO_LOGIC_NO_TIMEOUT	0xffffffff
+
+enum
+{
+  c_Cruising,         // 0
+  c_Transition,       // 1
+  c_Climbing,         // 2
+};
+
+//! ms from now until deadline, 0 if already passed
+static inline uint32_t ms_until (uint32_t deadline, uint32_t now)
+{
+  return (int32_t) (deadline - now) > 0 ? deadline - now : 0;
+}
+
+//! speed-commander chirp: decides when to sweep, the sweep itself runs in the audio ISR
+class chirp_controller_t
+{
+public:
+  enum mode_type
+  {
+    STOPPED, DOWN, UP
+  };
+
+  chirp_controller_t (void)
+  {
+    mode = STOPPED;
+    start_f = START_F;
+    stop_f = STOP_F;
+    rate = 0;
+    end_ms = 0;
+  }
+
+  void
+  set_limits (uint16_t low, uint16_t high)
+  {
+    start_f = low;
+    stop_f = high;
+  }
+
+  //! arm a sweep unless one in this direction is running, true if armed
+  bool
+  set_mode (mode_type mode, int16_t speed_error, uint32_t now_ms)
+  {
+    update (now_ms);
+    if (this->mode == mode)
+      return false;
+    this->mode = mode;
+
+    switch (mode)
+      {
+      case UP:
+	ASSERT( speed_error < 0);
+	rate = -speed_error * CHIRP_TICKS_PER_S;
+	break;
+      case DOWN: // sweeps down at half the rate
+	ASSERT( speed_error > 0);
+	rate = speed_error * CHIRP_TICKS_PER_S / 2;
+	break;
+      case STOPPED:
+	return false;
+      }
+    if (rate == 0)
+      {
+	this->mode = STOPPED;
+	return false;
+      }
+    end_ms = now_ms + ((stop_f - start_f) * 1000 + rate - 1) / rate;
+    return true;
+  }
+
+  //! the sweep is over once it has reached its stop frequency
+  void
+  update (uint32_t now_ms)
+  {
+    if ((mode != STOPPED) && ((int32_t) (now_ms - end_ms) >= 0))
+      mode = STOPPED;
+  }
+
+  bool is_active (void) const
+  {
+    return mode != STOPPED;
+  }
+  uint16_t get_start (void) const
+  {
+    return mode == UP ? start_f : stop_f;
+  }
+  uint16_t get_stop (void) const
+  {
+    return mode == UP ? stop_f : start_f;
+  }
+  uint32_t get_rate (void) const //!< Hz / s
+  {
+    return rate;
+  }
+  enum
+  {
+    START_F = 500, STOP_F = 3000, CHIRP_TICKS_PER_S = 1000 / AUDIO_TICK_MS
+  };
+private:
+  mode_type mode;
+  uint16_t start_f;
+  uint16_t stop_f;
+  uint32_t rate;
+  uint32_t end_ms;
+};
+
+//! settings for the sound output module (pieps.h)
+typedef struct
+{
+  uint16_t frequency;		//!< vario voice / Hz, 0 = silent
+  uint16_t volume;		//!< loudness step, see step_volume()
+  uint16_t chopper_period_ms;	//!< 0 = continuous tone
+  uint16_t chopper_on_ms;
+  uint16_t signal_frequency;	//!< signal voice / Hz, 0 = silent
+  uint16_t signal_volume;
+  uint32_t sweep_rate;		//!< Hz / s, != 0: start a sweep from frequency to sweep_stop
+  uint16_t sweep_stop;
+  bool sweeping;		//!< a sweep owns the vario frequency: no retune
+} audio_output_t;
+
+class audio_logic_t
+{
+public:
+  audio_logic_t (void)
+  : climbmode (0),
+    Interval (0),
+    Audio_Volume (0),
+    NormedFrequency (0),
+    climb (0),
+    speed_error (0),
+    speed_error_integrator (0),
+    CAN_RX_active (false),
+    periodic_work (false),
+    last_reception (0),
+    next_tick (0),
+    curve (0)
+  {
+  }
+
+  //! user tone mapping, 0 = classic mapping
+  void
+  set_tone_curve (const tone_curve *new_curve)
+  {
+    curve = new_curve;
+    if (curve)
+      chirp_controller.set_limits (curve->get_chirp_low (), curve->get_chirp_high ());
+    else
+      chirp_controller.set_limits (chirp_controller_t::START_F, chirp_controller_t::STOP_F);
+  }
+
+  //! play the power-up melody
+  void start (uint32_t now_ms)
+  {
+    sequencer.start (startup_melody, 0, now_ms);
+  }
+
+  //! decode the 8 bytes of c_CID_A57_Audio (little endian)
+  void
+  audio_frame (const uint8_t *data, uint32_t now_ms)
+  {
+    last_reception = now_ms;
+    if (! CAN_RX_active)
+      next_tick = now_ms;
+    CAN_RX_active = true;
+    climb = (int16_t) (data[0] | (data[1] << 8));
+    NormedFrequency = climb + 10000;
+    if (NormedFrequency < 0)
+      NormedFrequency = 0;
+    Interval = data[2] | (data[3] << 8);
+    Audio_Volume = data[4];
+    climbmode = data[6];
+    speed_error = -(int8_t) (data[7]);
+  }
+
+  //! bus-off: no more vario data, mute now instead of after CAN_RX_TIMEOUT_MS
+  void
+  CAN_outage (void)
+  {
+    CAN_RX_active = false;
+    periodic_work = false;
+    Audio_Volume = 0;
+  }
+
+  //! c_CID_A57_Signal: signal id + volume
+  void
+  signal_frame (uint8_t signal_id, uint8_t signal_volume, uint32_t now_ms)
+  {
+    sequencer.start (signal_id, signal_volume, now_ms);
+  }
+
+  //! vario data arriving, the CAN RX watchdog has not expired
+  bool
+  is_vario_active (void) const
+  {
+    return CAN_RX_active;
+  }
+
+  //! time until run() has work to do, AUDIO_LOGIC_NO_TIMEOUT if silent
+  uint32_t
+  timeout (uint32_t now_ms) const
+  {
+    uint32_t timeout = AUDIO_LOGIC_NO_TIMEOUT;
+    if (CAN_RX_active)
+      {
+	timeout = ms_until (last_reception + CAN_RX_TIMEOUT_MS, now_ms);
+	if (periodic_work && (ms_until (next_tick, now_ms) < timeout))
+	  timeout = ms_until (next_tick, now_ms);
+      }
+    if (sequencer.is_active ()
+	&& (ms_until (sequencer.get_deadline (), now_ms) < timeout))
+      timeout = ms_until (sequencer.get_deadline (), now_ms);
+    return timeout;
+  }
+
+  //! advance to now_ms and compute the output settings
+  audio_output_t
+  run (uint32_t now_ms)
+  {
+    sequencer.update (now_ms);
+
+    if (CAN_RX_active && (now_ms - last_reception >= CAN_RX_TIMEOUT_MS)) // kind of a watchdog
+      {
+	CAN_RX_active = false;
+	periodic_work = false;
+	Audio_Volume = 0;
+      }
+
+    // speed-commander state advances on the AUDIO_TICK_MS grid only
+    bool tick = (int32_t) (now_ms - next_tick) >= 0;
+    if (tick)
+      {
+	next_tick += AUDIO_TICK_MS;
+	if ((int32_t) (now_ms - next_tick) >= 0) // slept through idle ticks
+	  next_tick = now_ms + AUDIO_TICK_MS;
+      }
+
+    audio_output_t out =
+      { 0, Audio_Volume, 0, 0, 0, 0, 0, 0, false };
+
+    if (CAN_RX_active && (Audio_Volume > 0))
+      {
+	if ((climbmode != c_Cruising) && curve) // ** VARIO ** user mapping
+	  {
+	    periodic_work = false;
+	    curve->evaluate (climb, out.frequency, out.chopper_period_ms, out.chopper_on_ms);
+	  }
+
+	else if (climbmode != c_Cruising) // ** VARIO ** sound
+	  {
+	    // NormedFrequency >= 0: unsigned constant divisor, UMULL + shift instead of SDIV
+	    out.frequency = MINIMUM_FREQUENCY + (uint32_t) NormedFrequency / FREQUENCY_SHIFT;
+
+	    periodic_work = false; // the cadence is timed by hardware
+	    if (Interval > 10)
+	      {
+		// tone during the first half of the cadence
+		uint16_t period_ms = chopper_period (out.frequency);
+		if (period_ms < CHOPPER_CONTINUOUS_MS)
+		  {
+		    out.chopper_period_ms = period_ms;
+		    out.chopper_on_ms = period_ms / 2 + CHOPPER_TICK_MS / 2;
+		  }
+	      }
+	  }
+
+	else   // ** SPEED COMMANDER **  sound
+	  {
+	    periodic_work = true;
+	    bool armed = false;
+	    if (tick)
+	      {
+		speed_error_integrator += speed_error;
+		if (speed_error_integrator > 1000)
+		  {
+		    armed = chirp_controller.set_mode (chirp_controller_t::DOWN,
+						       speed_error, now_ms);
+		    speed_error_integrator = 0;
+		  }
+		else if (speed_error_integrator < -1000)
+		  {
+		    armed = chirp_controller.set_mode (chirp_controller_t::UP,
+						       speed_error, now_ms);
+		    speed_error_integrator = 0;
+		  }
+	      }
+
+	    chirp_controller.update (now_ms);
+	    if (chirp_controller.is_active ())
+	      {
+		out.frequency = chirp_controller.get_start ();
+		out.sweeping = true;
+		if (armed)
+		  {
+		    out.sweep_rate = chirp_controller.get_rate ();
+		    out.sweep_stop = chirp_controller.get_stop ();
+		  }
+	      }
+
+	    if (speed_error > 0)
+	      {
+		out.chopper_period_ms = SPEED_CHOPPER_PERIOD_MS;
+		out.chopper_on_ms = SPEED_CHOPPER_ON_MS;
+	      }
+	  }
+      } // volume > 0
+    else
+      periodic_work = false;
+
+    if (sequencer.is_active ()) // signal on its own voice, over the vario
+      {
+	if (sequencer.preempts_vario ())
+	  out.frequency = 0;
+	else
+	  out.volume = signal_sequencer::duck (out.volume);
+
+	if (sequencer.is_sounding ())
+	  {
+	    out.signal_frequency = sequencer.get_frequency ();
+	    out.signal_volume = sequencer.get_volume ();
+	  }
+      }
+
+    if (out.volume == 0)
+      out.frequency = 0;
+    if (out.frequency == 0)
+      {
+	out.sweep_rate = 0;
+	out.sweeping = false;
+      }
+    if (out.signal_volume == 0)
+      out.signal_frequency = 0;
+    return out;
+  }
+
+private:
+  uint8_t climbmode;
+  uint16_t Interval;
+  uint16_t Audio_Volume;
+  int32_t NormedFrequency;
+  int16_t climb;		//!< raw value as received
+
+  int8_t speed_error;
+  int16_t speed_error_integrator;
+  chirp_controller_t chirp_controller;
+  signal_sequencer sequencer;
+
+  bool CAN_RX_active;
+  bool periodic_work;
+  uint32_t last_reception;	//!< ms
+  uint32_t next_tick;		//!< ms
+  const tone_curve *curve;
+};
+
+#endif /* AUDIO_LOGIC_H_ */
@@ -0,0 +1,105 @@
+/**
+ * @file    baro_vario.h
+ * @brief   Fixed-point alpha-beta filter: static pressure -> climb rate
+ *
+ * Plain C++ without any HAL dependency.
+ * The filter tracks pressure and its rate of change, the climb rate is
+ * the pressure rate times the local altitude per pressure step,
+ * which is refreshed from temperature and pressure once per second.
+ * Working on pressure instead of altitude needs no reference level
+ * and no logarithm in the sample loop.
+ *
+ * Pressure is kept in Q16 Pa (int64_t), the rate in Q16 Pa/s.
+ * alpha and beta are critically damped: beta = alpha^2 / (2 - alpha).
+ * BARO_VARIO_LAG_MS is the time the climb output needs to reach 50% of
+ * a climb rate step, simulated with the coefficients below.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BARO_VARIO_H_
+#define BARO_VARIO_H_
+
+#include <stdint.h>
+
+#define BARO_VARIO_PERIOD_MS	20	// forced mode cycle, one pressure sample each
+#define BARO_VARIO_ALPHA	5243	// 0.08 Q16
+#define BARO_VARIO_BETA		218	// 0.00333 Q16
+#define BARO_VARIO_LAG_MS	500	// 50% of a climb step at 50 Hz
+
+#define GAS_CONSTANT_AIR	287.05f	// J / (kg K)
+#define GRAVITY			9.80665f
+
+class baro_vario_filter
+{
+public:
+  baro_vario_filter( void)
+  : pressure( 0),
+    rate( 0),
+    mm_per_Pa( 83 << 16), // ISA sea level
+    initialized( false)
+  {}
+
+  //! altitude per pressure step from the hypsometric equation
+  void set_atmosphere( float temperature_C, float pressure_Pa)
+  {
+    if( pressure_Pa < 10000.0f)
+      return;
+    float scale = GAS_CONSTANT_AIR * (temperature_C + 273.15f) / (GRAVITY * pressure_Pa) * 1000.0f;
+    mm_per_Pa = (int32_t)( scale * 65536.0f);
+  }
+
+  //! one sample every BARO_VARIO_PERIOD_MS
+  void step( float pressure_Pa)
+  {
+    int64_t measurement = (int64_t)( pressure_Pa * 256.0f) << 8;
+    if( ! initialized)
+      {
+	pressure = measurement;
+	rate = 0;
+	initialized = true;
+	return;
+      }
+
+    int64_t predicted = pressure + (int64_t)rate * BARO_VARIO_PERIOD_MS / 1000;
+    int64_t residual = measurement - predicted;
+    pressure = predicted + ((residual * BARO_VARIO_ALPHA) >> 16);
+    rate += (int32_t)( (residual * BARO_VARIO_BETA * 1000 / BARO_VARIO_PERIOD_MS) >> 16);
+  }
+
+  //! restart after a sensor failure
+  void reset( void)
+  {
+    initialized = false;
+  }
+
+  int32_t get_climb_mm_s( void) const
+  {
+    return (int32_t)( -((int64_t)rate * mm_per_Pa) >> 32);
+  }
+
+private:
+  int64_t pressure;	//!< Q16 Pa
+  int32_t rate;		//!< Q16 Pa / s
+  int32_t mm_per_Pa;	//!< Q16
+  bool initialized;
+};
+
+#endif /* BARO_VARIO_H_ */
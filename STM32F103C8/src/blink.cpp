@@ -38,7 +38,7 @@ void blink_code( void *)
 	  {
 		  HAL_GPIO_WritePin( LED_PORT, LED_PIN, GPIO_PIN_RESET);
 #if CAN_RUN_TESTCODE
-		  CAN_RX_queue.receive( dummy);
+		  CAN_receive( dummy);
 		  if( dummy.id == 100)
 		    {
 		      __disable_irq();
@@ -53,7 +53,7 @@ void blink_code( void *)
 #endif
 		  HAL_GPIO_WritePin( LED_PORT,LED_PIN, GPIO_PIN_SET);
 #if CAN_RUN_TESTCODE
-		  CAN_RX_queue.receive( dummy);
+		  CAN_receive( dummy);
 		  ++dummy.data_l;
 		  ++dummy.id;
 		  CAN_send(dummy);
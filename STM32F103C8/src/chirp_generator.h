@@ -0,0 +1,112 @@
+/**
+ * @file    chirp_generator.h
+ * @brief   Linear frequency sweep evaluated inside the audio ISR
+ *
+ * Plain C++ without any HAL dependency.
+ * The task arms a sweep with start, stop frequency and rate, the ISR
+ * advances it by the time elapsed since its last call, i.e. at the
+ * tone's own toggle rate or per sample buffer.
+ * The frequency is kept in Q32 Hz, the slope in Q32 Hz per time unit:
+ * one 32 x 32 bit multiplication per step, no division.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHIRP_GENERATOR_H_
+#define CHIRP_GENERATOR_H_
+
+#include <stdint.h>
+
+//! keeps the compiler from moving memory accesses across, single core: no DMB needed
+#define CHIRP_COMPILER_BARRIER()	__asm__ volatile ( "" ::: "memory")
+
+template <unsigned TICKS_PER_MS> class chirp_generator
+{
+public:
+  chirp_generator( void)
+  : frequency( 0),
+    stop( 0),
+    slope( 0),
+    rising( true),
+    active( false)
+  {}
+
+  //! sweep from start_Hz to stop_Hz at rate_Hz_per_s, called from task level
+  void arm( uint16_t start_Hz, uint16_t stop_Hz, uint32_t rate_Hz_per_s)
+  {
+    active = false; // the ISR must not see a half written sweep
+    CHIRP_COMPILER_BARRIER();
+    uint64_t max_rate = (uint64_t)TICKS_PER_MS * 1000 - 1;
+    if( rate_Hz_per_s > max_rate)
+      rate_Hz_per_s = max_rate;
+    frequency = (uint64_t)start_Hz << 32;
+    stop = (uint64_t)stop_Hz << 32;
+    slope = (uint32_t)( ((uint64_t)rate_Hz_per_s << 32) / (TICKS_PER_MS * 1000));
+    rising = stop_Hz > start_Hz;
+    CHIRP_COMPILER_BARRIER(); // plain stores above, volatile flag below
+    active = (slope != 0) && (stop_Hz != start_Hz);
+  }
+
+  void cancel( void)
+  {
+    active = false;
+  }
+
+  bool is_active( void) const
+  {
+    return active;
+  }
+
+  //! advance by elapsed time units and return the new frequency / Hz, held at the end
+  uint16_t step( uint32_t elapsed)
+  {
+    uint64_t delta = (uint64_t)elapsed * slope;
+    if( rising)
+      {
+	if( delta >= stop - frequency)
+	  {
+	    frequency = stop;
+	    active = false;
+	  }
+	else
+	  frequency += delta;
+      }
+    else
+      {
+	if( delta >= frequency - stop)
+	  {
+	    frequency = stop;
+	    active = false;
+	  }
+	else
+	  frequency -= delta;
+      }
+    return (uint16_t)(frequency >> 32);
+  }
+
+private:
+  uint64_t frequency;	//!< Q32 Hz
+  uint64_t stop;	//!< Q32 Hz
+  uint32_t slope;	//!< Q32 Hz per time unit
+  bool rising;
+  volatile bool active;
+};
+
+#endif /* CHIRP_GENERATOR_H_ */
@@ -0,0 +1,96 @@
+/**
+ * @file    chopper_cadence.h
+ * @brief   Vario beep cadence counted in output samples
+ *
+ * Plain C++ without any HAL dependency.
+ * The task sets period and on time in ms, the audio ISR advances the
+ * cadence once per sample and gets the gate state of that sample.
+ * Both values travel in one 32 bit word: the ISR sees the old or the new
+ * cadence, never a mix. A running cadence takes a change over at its
+ * period end, a continuous tone starts chopping at once with the on phase.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHOPPER_CADENCE_H_
+#define CHOPPER_CADENCE_H_
+
+#include <stdint.h>
+
+//! period 0 or an on time covering the period = continuous tone, both set to 0
+inline void chopper_timing( uint16_t &period_ms, uint16_t &on_ms, uint16_t max_period_ms = 0xffff)
+{
+  if( period_ms > max_period_ms)
+    period_ms = max_period_ms;
+  if( (period_ms == 0) || (on_ms >= period_ms))
+    period_ms = on_ms = 0;
+}
+
+template <unsigned TICKS_PER_MS> class chopper_cadence
+{
+public:
+  chopper_cadence( void)
+  : staged( 0),
+    period( 0),
+    on( 0),
+    phase( 0)
+  {}
+
+  //! on for on_ms out of every period_ms, period 0 = continuous, called from task level
+  void set( uint16_t period_ms, uint16_t on_ms)
+  {
+    chopper_timing( period_ms, on_ms);
+    staged = ((uint32_t)period_ms << 16) | on_ms;
+  }
+
+  //! gate state of the present sample, then advance by one sample
+  bool step( void)
+  {
+    if( phase == 0)
+      {
+	uint32_t request = staged;
+	period = (request >> 16) * TICKS_PER_MS;
+	on = (request & 0xffff) * TICKS_PER_MS;
+      }
+    if( period == 0)
+      return true;
+
+    bool open = phase < on;
+    if( ++phase >= period)
+      phase = 0;
+    return open;
+  }
+
+  //! gate state of the next sample
+  bool is_open( void) const
+  {
+    if( phase == 0)
+      return true; // a new period or a continuous tone
+    return phase < on;
+  }
+
+private:
+  volatile uint32_t staged;	//!< period_ms << 16 | on_ms
+  uint32_t period;		//!< samples, 0 = continuous
+  uint32_t on;			//!< samples
+  uint32_t phase;		//!< samples since the period start
+};
+
+#endif /* CHOPPER_CADENCE_H_ */
@@ -0,0 +1,144 @@
+/**
+ * @file    dds_oscillator.h
+ * @brief   Direct digital synthesis oscillator, compile-time generated wavetables
+ *
+ * Plain C++ without any HAL dependency.
+ * A 32-bit phase accumulator addresses a wavetable of DDS_TABLE_SIZE
+ * samples using its upper DDS_TABLE_BITS bits.
+ * Retuning only exchanges the phase increment, the phase is kept,
+ * so frequency changes are phase-continuous and need no division.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DDS_OSCILLATOR_H_
+#define DDS_OSCILLATOR_H_
+
+#include <stdint.h>
+#include "embedded_memory.h"
+
+#define DDS_TABLE_BITS	8
+#define DDS_TABLE_SIZE	(1 << DDS_TABLE_BITS)
+
+#define DDS_PI		3.14159265358979323846
+
+//! sine for table generation at compile time, argument range -pi .. pi
+constexpr double dds_sine( double x)
+{
+  double term = x;
+  double sum = x;
+  for( int n = 1; n < 12; ++n)
+    {
+      term *= -x * x / ((2 * n) * (2 * n + 1));
+      sum += term;
+    }
+  return sum;
+}
+
+//! one period of a waveform built from up to three harmonics, peak = 32767
+class dds_wavetable
+{
+public:
+  constexpr dds_wavetable( double h1, double h2 = 0.0, double h3 = 0.0)
+  : sample()
+  {
+    double peak = 0.0;
+    for( int i = 0; i < DDS_TABLE_SIZE; ++i)
+      {
+	double value = waveform( i, h1, h2, h3);
+	if( value < 0.0)
+	  value = -value;
+	if( value > peak)
+	  peak = value;
+      }
+    for( int i = 0; i < DDS_TABLE_SIZE; ++i)
+      {
+	double value = 32767.0 * waveform( i, h1, h2, h3) / peak;
+	sample[i] = (int16_t)( value < 0.0 ? value - 0.5 : value + 0.5); // rounded
+      }
+  }
+  int16_t sample[DDS_TABLE_SIZE];
+
+private:
+  //! sine of harmonic * 2pi * index / DDS_TABLE_SIZE
+  static constexpr double harmonic( int index, int harmonic)
+  {
+    int reduced = (index * harmonic) % DDS_TABLE_SIZE;
+    if( reduced > DDS_TABLE_SIZE / 2)
+      reduced -= DDS_TABLE_SIZE;
+    return dds_sine( 2.0 * DDS_PI * reduced / DDS_TABLE_SIZE);
+  }
+  static constexpr double waveform( int index, double h1, double h2, double h3)
+  {
+    return h1 * harmonic( index, 1) + h2 * harmonic( index, 2) + h3 * harmonic( index, 3);
+  }
+};
+
+//! pure sine
+CONSTEXPR_ROM dds_wavetable dds_sine_table( 1.0);
+
+//! brighter timbre, better audible in a noisy cockpit
+CONSTEXPR_ROM dds_wavetable dds_timbre_table( 1.0, 0.5, 0.25);
+
+//! phase accumulator oscillator running at a fixed sample rate
+template <uint32_t SAMPLE_RATE> class dds_oscillator
+{
+public:
+  dds_oscillator( const int16_t *table = dds_sine_table.sample)
+  : wavetable( table),
+    phase( 0),
+    phase_increment( 0)
+  {}
+
+  //! phase-continuous retune, multiplication only
+  void set_frequency( uint16_t frequency_Hz)
+  {
+    if( frequency_Hz >= SAMPLE_RATE / 2)
+      frequency_Hz = SAMPLE_RATE / 2 - 1;
+    phase_increment = frequency_Hz * PHASE_INCREMENT_PER_HZ;
+  }
+
+  //! select a table of DDS_TABLE_SIZE samples, RAM or ROM
+  void set_waveform( const int16_t *table)
+  {
+    wavetable = table;
+  }
+
+  //! advance by one sample period and return the new sample
+  inline int16_t step( void)
+  {
+    phase += phase_increment;
+    return wavetable[ phase >> (32 - DDS_TABLE_BITS)];
+  }
+
+  uint32_t get_phase_increment( void) const
+  {
+    return phase_increment;
+  }
+
+  static constexpr uint32_t PHASE_INCREMENT_PER_HZ = (uint32_t)( 0x100000000ULL / SAMPLE_RATE);
+
+private:
+  const int16_t * volatile wavetable;
+  uint32_t phase;
+  volatile uint32_t phase_increment;
+};
+
+#endif /* DDS_OSCILLATOR_H_ */
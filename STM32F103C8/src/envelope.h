@@ -0,0 +1,111 @@
+/**
+ * @file    envelope.h
+ * @brief   Attack / release envelope for the loudness level
+ *
+ * Plain C++ without any HAL dependency.
+ * The level ramps linearly toward the requested target.
+ * Time is counted in arbitrary units (timer counts, samples),
+ * the slopes are given in Q16 level units per time unit.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ENVELOPE_H_
+#define ENVELOPE_H_
+
+#include <stdint.h>
+
+class envelope_generator
+{
+public:
+  envelope_generator( void)
+  : level( 0),
+    target( 0),
+    attack_slope( 0xffffffff),
+    release_slope( 0xffffffff)
+  {}
+
+  //! slope to ramp over full_scale within ramp_time time units
+  static uint32_t slope( uint16_t full_scale, uint32_t ramp_time)
+  {
+    if( ramp_time == 0)
+      return 0xffffffff; // jump
+    return ((uint32_t)full_scale << 16) / ramp_time;
+  }
+
+  void configure( uint32_t new_attack_slope, uint32_t new_release_slope)
+  {
+    attack_slope = new_attack_slope;
+    release_slope = new_release_slope;
+  }
+
+  void set_target( uint16_t new_target)
+  {
+    target = new_target;
+  }
+
+  //! advance by elapsed time units and return the new level
+  uint16_t step( uint32_t elapsed)
+  {
+    uint32_t target_q16 = (uint32_t)target << 16;
+
+    if( level < target_q16)
+      {
+	uint64_t delta = (uint64_t)elapsed * attack_slope;
+	if( delta >= target_q16 - level)
+	  level = target_q16;
+	else
+	  level += (uint32_t)delta;
+      }
+    else if( level > target_q16)
+      {
+	uint64_t delta = (uint64_t)elapsed * release_slope;
+	if( delta >= level - target_q16)
+	  level = target_q16;
+	else
+	  level -= (uint32_t)delta;
+      }
+    return (uint16_t)(level >> 16);
+  }
+
+  uint16_t get_level( void) const
+  {
+    return (uint16_t)(level >> 16);
+  }
+
+  uint16_t get_target( void) const
+  {
+    return target;
+  }
+
+  //! true if silent and staying silent
+  bool is_idle( void) const
+  {
+    return (level == 0) && (target == 0);
+  }
+
+private:
+  uint32_t level; //!< Q16
+  volatile uint16_t target;
+  uint32_t attack_slope;
+  uint32_t release_slope;
+};
+
+#endif /* ENVELOPE_H_ */
@@ -0,0 +1,63 @@
+/**
+ * @file    frequency_mapping.h
+ * @brief   Tone frequency to timer period and chopper period
+ *
+ * Plain C++ without any HAL dependency.
+ * Two divisions per tone update, both rounded to nearest.
+ * Interpolated lookup tables have been tried instead: by the Cortex-M3
+ * cycle model in host/frequency_model they take 34 cycles against 23
+ * for both divisions (UDIV terminates early for these quotients) and
+ * 1.5 kByte of flash, so the divisions stay.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FREQUENCY_MAPPING_H_
+#define FREQUENCY_MAPPING_H_
+
+#include <stdint.h>
+
+#define SIGNAL_PERIOD_BASE_VALUE 12000000 // TIM2 toggle mode: 2 toggles per period @ 24 MHz
+
+#define CHOPPER_PERIOD		20000
+#define CHOPPER_SHIFT		500
+#define CHOPPER_TICK_MS		10	// unit of the chopper formula
+#define CHOPPER_CONTINUOUS_MS	6000	// longer cadences are played as continuous tone
+
+//! TIM2 auto-reload value, clamped to 16 bits
+inline uint16_t timer_period( uint16_t frequency_Hz)
+{
+  if( frequency_Hz == 0)
+    return 0xffff;
+  uint32_t period = (SIGNAL_PERIOD_BASE_VALUE + frequency_Hz / 2) / frequency_Hz;
+  return period > 0xffff ? 0xffff : period;
+}
+
+//! beep cadence / ms: (CHOPPER_PERIOD / (f - CHOPPER_SHIFT) + 1) * CHOPPER_TICK_MS, CHOPPER_CONTINUOUS_MS = no chopping
+inline uint16_t chopper_period( uint16_t frequency_Hz)
+{
+  if( frequency_Hz <= CHOPPER_SHIFT)
+    return CHOPPER_CONTINUOUS_MS;
+  uint32_t shifted = frequency_Hz - CHOPPER_SHIFT;
+  uint32_t period = (CHOPPER_PERIOD * CHOPPER_TICK_MS + shifted / 2) / shifted + CHOPPER_TICK_MS;
+  return period > CHOPPER_CONTINUOUS_MS ? CHOPPER_CONTINUOUS_MS : period;
+}
+
+#endif /* FREQUENCY_MAPPING_H_ */
@@ -0,0 +1,117 @@
+/**
+ * @file    latency_histogram.h
+ * @brief   Latency statistics: min, mean, max and percentiles
+ *
+ * Plain C++ without any HAL dependency.
+ * Samples are sorted into LATENCY_BINS bins of LATENCY_BIN_USEC each,
+ * the last bin collects everything beyond. Percentiles are reported as
+ * the upper edge of the bin containing them.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#define LATENCY_BINS		64
+#define LATENCY_BIN_USEC	100	// -> 6.4 ms resolved range
+
+class latency_histogram
+{
+public:
+  latency_histogram( void)
+  {
+    reset();
+  }
+
+  void reset( void)
+  {
+    for( unsigned i = 0; i < LATENCY_BINS; ++i)
+      bin[i] = 0;
+    count = 0;
+    sum = 0;
+    minimum = 0xffffffff;
+    maximum = 0;
+  }
+
+  void add( uint32_t usec)
+  {
+    uint32_t index = usec / LATENCY_BIN_USEC;
+    if( index >= LATENCY_BINS)
+      index = LATENCY_BINS - 1;
+    ++bin[index];
+    ++count;
+    sum += usec;
+    if( usec < minimum)
+      minimum = usec;
+    if( usec > maximum)
+      maximum = usec;
+  }
+
+  uint32_t get_count( void) const
+  {
+    return count;
+  }
+
+  uint32_t get_minimum( void) const
+  {
+    return count ? minimum : 0;
+  }
+
+  uint32_t get_maximum( void) const
+  {
+    return maximum;
+  }
+
+  uint32_t get_mean( void) const
+  {
+    return count ? (uint32_t)( sum / count) : 0;
+  }
+
+  //! latency not exceeded by per_mille / 1000 of the samples
+  uint32_t get_percentile( unsigned per_mille) const
+  {
+    if( count == 0)
+      return 0;
+    uint64_t needed = ((uint64_t)count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for( unsigned i = 0; i < LATENCY_BINS - 1; ++i)
+      {
+	seen += bin[i];
+	if( seen >= needed)
+	  {
+	    uint32_t edge = (i + 1) * LATENCY_BIN_USEC;
+	    return edge < maximum ? edge : maximum;
+	  }
+      }
+    return maximum;
+  }
+
+private:
+  uint32_t bin[LATENCY_BINS];
+  uint32_t count;
+  uint64_t sum;
+  uint32_t minimum;
+  uint32_t maximum;
+};
+
+#endif /* LATENCY_HISTOGRAM_H_ */
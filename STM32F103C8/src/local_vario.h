@@ -0,0 +1,186 @@
+/***********************************************************************//**
+ * @file     	local_vario.h
+ * @brief    	Fallback: c_CID_A57_Audio frames synthesized from sensor box data
+ * @author	Dr. Klaus Schaefer
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ * Plain C++ without any HAL or RTOS dependency.
+ * If c_CID_A57_Audio stays missing for FALLBACK_DELAY_MS while the
+ * sensor box is alive, every c_CID_KSB_Vario frame is turned into an
+ * audio frame for audio_logic_t. The delay is shorter than the logic's
+ * CAN_RX_TIMEOUT_MS, so the tone never drops out, and the first
+ * A57 frame takes over again.
+ *
+ * As last resort the climb rate of the local pressure sensor
+ * (c_CID_AUD_Baro_Vario) is used while c_CID_KSB_Vario is missing, too.
+ *
+ * Speed to fly for MacCready 0 from the glider polar
+ * sink(v) = a v^2 + b v + c:  v_stf = sqrt( (c - w) / a),
+ * w = air mass vertical speed = vario + sink( IAS).
+ *
+ **************************************************************************/
+
+#ifndef LOCAL_VARIO_H_
+#define LOCAL_VARIO_H_
+
+#include <stdint.h>
+#include <math.h>
+
+#define FALLBACK_DELAY_MS	500	// A57 silence before the fallback takes over
+#define SENSOR_TIMEOUT_MS	500	// sensor box data older than this is not used
+#define FALLBACK_VOLUME		7	// loudness steps until A57 has told us better
+#define FALLBACK_INTERVAL	100	// chopped tone when climbing, see audio_logic_t
+
+// standard class polar, sink rate / m/s over IAS / m/s
+#define POLAR_A			0.0018225f
+#define POLAR_B			-0.06975f
+#define POLAR_C			1.25f
+#define STF_MINIMUM		(80.0f / 3.6f)
+#define STF_MAXIMUM		(250.0f / 3.6f)
+
+class local_vario_t
+{
+public:
+  local_vario_t (void)
+  : last_A57 (0),
+    last_vario (0),
+    last_airspeed (0),
+    last_climbmode (0),
+    A57_seen (false),
+    vario_seen (false),
+    airspeed_seen (false),
+    climbmode_seen (false),
+    volume (FALLBACK_VOLUME),
+    IAS (0.0f),
+    climbmode (0)
+  {
+  }
+
+  //! c_CID_A57_Audio arrived: no fallback, remember the pilot's volume
+  void
+  A57_frame (const uint8_t *data, uint32_t now_ms)
+  {
+    last_A57 = now_ms;
+    A57_seen = true;
+    volume = data[4];
+  }
+
+  //! c_CID_KSB_Airspeed: uint16_t TAS, IAS / km/h
+  void
+  airspeed_frame (const uint8_t *data, uint32_t now_ms)
+  {
+    IAS = (float) (data[2] | (data[3] << 8)) / 3.6f;
+    last_airspeed = now_ms;
+    airspeed_seen = true;
+  }
+
+  //! c_CID_KSB_Acceleration: byte 6 = climb mode
+  void
+  acceleration_frame (const uint8_t *data, uint32_t now_ms)
+  {
+    climbmode = data[6];
+    last_climbmode = now_ms;
+    climbmode_seen = true;
+  }
+
+  bool
+  is_active (uint32_t now_ms) const
+  {
+    return ! A57_seen || (now_ms - last_A57 >= FALLBACK_DELAY_MS);
+  }
+
+  //! c_CID_KSB_Vario: int16_t vario / mm/s, true if audio_frame has been filled
+  bool
+  vario_frame (const uint8_t *data, uint32_t now_ms, uint8_t *audio_frame)
+  {
+    last_vario = now_ms;
+    vario_seen = true;
+    if (! is_active (now_ms))
+      return false;
+
+    int16_t vario = (int16_t) (data[0] | (data[1] << 8));
+    // without the sensor box's decision: vario
+    uint8_t mode = fresh (climbmode_seen, last_climbmode, now_ms) ? climbmode : (uint8_t) 2;
+    bool climbing = mode != 0;
+
+    int8_t speed_error = 0; // IAS - speed to fly / km/h, positive = too fast
+    if (! climbing && fresh (airspeed_seen, last_airspeed, now_ms))
+      {
+	float error = (IAS - speed_to_fly (vario * 0.001f)) * 3.6f;
+	speed_error = error > 127.0f ? 127 : error < -127.0f ? -127 : (int8_t) error;
+      }
+
+    fill (vario, mode, speed_error, audio_frame);
+    return true;
+  }
+
+  //! c_CID_AUD_Baro_Vario: int16_t climb / mm/s, used if the sensor box is silent, too
+  bool
+  baro_frame (const uint8_t *data, uint32_t now_ms, uint8_t *audio_frame) const
+  {
+    if (! is_active (now_ms) || fresh (vario_seen, last_vario, now_ms))
+      return false;
+
+    fill ((int16_t) (data[0] | (data[1] << 8)), 2, 0, audio_frame);
+    return true;
+  }
+
+private:
+  void
+  fill (int16_t vario, uint8_t mode, int8_t speed_error, uint8_t *audio_frame) const
+  {
+    uint16_t interval = vario > 0 ? FALLBACK_INTERVAL : 0;
+    audio_frame[0] = vario & 0xff;
+    audio_frame[1] = (vario >> 8) & 0xff;
+    audio_frame[2] = interval & 0xff;
+    audio_frame[3] = interval >> 8;
+    audio_frame[4] = volume;
+    audio_frame[5] = 0;
+    audio_frame[6] = mode;
+    audio_frame[7] = (uint8_t) speed_error;
+  }
+
+  static bool
+  fresh (bool seen, uint32_t last_ms, uint32_t now_ms)
+  {
+    return seen && (now_ms - last_ms < SENSOR_TIMEOUT_MS);
+  }
+
+  float
+  speed_to_fly (float vario) const
+  {
+    float air_mass = vario + (POLAR_A * IAS + POLAR_B) * IAS + POLAR_C;
+    float square = (POLAR_C - air_mass) / POLAR_A;
+    float v = square > 0.0f ? sqrtf (square) : 0.0f;
+    return v < STF_MINIMUM ? STF_MINIMUM : v > STF_MAXIMUM ? STF_MAXIMUM : v;
+  }
+
+  uint32_t last_A57;
+  uint32_t last_vario;
+  uint32_t last_airspeed;
+  uint32_t last_climbmode;
+  bool A57_seen;
+  bool vario_seen;
+  bool airspeed_seen;
+  bool climbmode_seen;
+  uint8_t volume;
+  float IAS;		//!< m/s
+  uint8_t climbmode;
+};
+
+#endif /* LOCAL_VARIO_H_ */
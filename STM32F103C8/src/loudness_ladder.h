@@ -0,0 +1,107 @@
+/**
+ * @file    loudness_ladder.h
+ * @brief   Open-drain resistor ladder attenuating the tone output
+ *
+ * Plain C++ without any HAL dependency, shared by pieps.cpp and the
+ * host renderer. A set bit releases the open-drain pin, a cleared bit
+ * pulls its resistor to ground and attenuates the signal node.
+ *
+ * Resistor assignment:
+ * PA0, PA1: 120kOhm (tone, quadrature square waves)
+ * PA2 60kOhm
+ * PA3 30kOhm
+ * PA4 15kOhm
+ * PA5 7.5kOhm
+ * PA6 3.6kOhm
+ * PA7 1.8kOhm
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOUDNESS_LADDER_H_
+#define LOUDNESS_LADDER_H_
+
+#include <stdint.h>
+#include "embedded_memory.h"
+
+#define LOUDNESS_STEPS		15
+#define MAX_LOUDNESS_LEVEL	((LOUDNESS_STEPS - 1) << 8) // envelope level = ladder code * 256
+#define LADDER_PINS		0xfc // PA2 .. PA7
+#define ATTACK_TIME_MS		3
+#define RELEASE_TIME_MS		5
+
+CONSTEXPR_ROM uint8_t LOUDNESS_BITS[LOUDNESS_STEPS]=
+{
+    0,
+    0b00111110,
+    0b01111110,
+    0b10011110,
+    0b10111110,
+    0b11001110,
+    0b11011110,
+    0b11100110,
+    0b11101110,
+    0b11110010,
+    0b11110110,
+    0b11111000,
+    0b11111010,
+    0b11111100,
+    0b11111110
+};
+
+#define TONE_RESISTOR_OHM	120e3 // PA0, PA1
+
+CONSTEXPR_ROM double LADDER_RESISTOR_OHM[8] = { 0.0, 0.0, 60e3, 30e3, 15e3, 7.5e3, 3.6e3, 1.8e3 };
+
+//! summing node voltage per tone pin high, 1.0 = pin voltage
+constexpr double ladder_node_gain( unsigned code)
+{
+  double conductance = 2.0 / TONE_RESISTOR_OHM;
+  uint8_t bits = LOUDNESS_BITS[code] & LADDER_PINS;
+  for( unsigned pin = 2; pin < 8; ++pin)
+    if( (bits & (1 << pin)) == 0)
+      conductance += 1.0 / LADDER_RESISTOR_OHM[pin];
+  return 1.0 / (TONE_RESISTOR_OHM * conductance);
+}
+
+//! node gain per ladder code relative to the loudest code, Q15
+class ladder_gain_table
+{
+public:
+  constexpr ladder_gain_table( void)
+  : gain()
+  {
+    for( unsigned code = 0; code < LOUDNESS_STEPS; ++code)
+      gain[code] = (uint16_t)( 32767.0 * ladder_node_gain( code)
+			       / ladder_node_gain( LOUDNESS_STEPS - 1) + 0.5);
+  }
+
+  uint16_t operator[]( unsigned code) const
+  {
+    return gain[code];
+  }
+
+private:
+  uint16_t gain[LOUDNESS_STEPS];
+};
+
+CONSTEXPR_ROM ladder_gain_table LADDER_GAIN;
+
+#endif /* LOUDNESS_LADDER_H_ */
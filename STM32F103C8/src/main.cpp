@@ -169,6 +169,12 @@ getTime_usec (void)
   time *= 1000;
 
   present_systick = reload - present_systick; // because it's a down-counter
+
+  // the counter has wrapped but the tick interrupt has not been served yet,
+  // e.g. called from an ISR of the same priority as SysTick
+  if( ((*(uint32_t*) 0xe000ed04) & (1 << 26)) && (present_systick < reload / 2))
+    time += 1000;
+
   present_systick *= 1000; // millisecs -> microsecs
   present_systick /= reload;
 
@@ -2,16 +2,48 @@
  * @file    pieps.cpp
  * @brief   Semi-sine-wave output (Quadrature 2channel Signal)
  *
- * 8 loudness steps via simple R-divider on PA2 .. PA7
+ * 15 loudness steps via simple R-divider on PA2 .. PA7 (loudness_ladder.h)
  *
- * Resistor assignment:
- * PA0, PA1: 120kOhm
- * PA2 60kOhm
- * PA3 30kOhm
- * PA4 15kOhm
- * PA5 7.5kOhm
- * PA6 3.6kOhm
- * PA7 1.8kOhm
+ * With AUDIO_VOLUME_DITHERING the ladder alternates between two adjacent
+ * codes: TIM4 requests a DMA1 channel 7 transfer from a 16 word pattern
+ * into GPIOA->BSRR at 576 kHz, the fraction of slots holding the upper
+ * code sets the level in between. The audio ISR only rewrites the
+ * pattern when the envelope level changes.
+ *
+ * With AUDIO_WAVETABLE_OUTPUT TIM2 runs as a 40 kHz PWM DAC instead.
+ * A circular DMA burst on the update event feeds CCR1 and CCR2 from
+ * a double buffer, the CPU refills one half on each half/full-transfer
+ * interrupt from a DDS oscillator (dds_oscillator.h).
+ *
+ * The beep cadence is gated where the output is timed. In toggle mode
+ * TIM3 counts the cadence, its compare and update events make DMA1
+ * channels 6 and 3 copy a prepared TIM2->CCMR1 image: the vario channels
+ * are switched between toggle and forced inactive at the exact TIM3
+ * count, without any CPU work between two set_chopper() calls.
+ * TIM2, its ISR and the envelope keep running. In wavetable mode the
+ * fill loop counts the cadence in samples (chopper_cadence.h) and
+ * mutes the vario voice from the exact sample on.
+ * The envelope follows the gate state for a soft beep onset.
+ *
+ * Two voices: the vario tone and an overlay signal, PA0 carries the
+ * vario voice and PA1 the signal voice while both sound, the resistor
+ * network mixes them. In toggle mode TIM2 counts freely and each channel
+ * schedules its next toggle by advancing its own compare register, so
+ * the voices have independent frequencies at no per-sample cost.
+ * The CC2 interrupt is enabled only while the voices differ, a single
+ * voice costs one interrupt per half period.
+ * The ladder is shared: it follows the louder voice, in wavetable mode
+ * the quieter voice is scaled digitally. While a signal sounds the
+ * ladder belongs to it, the cadence then switches the vario channel.
+ * A single voice drives both pins in quadrature as before.
+ *
+ * The speed-commander chirp is a chirp_generator armed by the task and
+ * advanced by the audio ISR at every toggle or sample buffer. It keeps
+ * sweeping in real time, through the off phases of the cadence, too.
+ *
+ * With RUN_AUDIO_BENCHMARK the audio ISR keeps DWT based statistics
+ * for audio_benchmark.cpp: CPU time, compare-to-entry latency,
+ * the half periods actually output and the vario gate cadence.
  *
  * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
 
@@ -38,72 +70,680 @@
 #include "stm32f1xx_hal.h"
 #include "stm32f1xx_hal_tim.h"
 #include "pieps.h"
+#include "dds_oscillator.h"
+#include "envelope.h"
+#include "chirp_generator.h"
+#include "chopper_cadence.h"
+#include "voice_routing.h"
+#if ! AUDIO_WAVETABLE_OUTPUT
+#include "toggle_periods.h"
+#endif
+#include "frequency_mapping.h"
+#include "loudness_ladder.h"
+
+#define AUDIO_ISR_PRIORITY	10 // above configMAX_SYSCALL_INTERRUPT_PRIORITY: no RTOS calls !
 
-#define SIGNAL_PERIOD_BASE_VALUE 12000000
+#define TIMER_CLOCK		72000000
+#define CHOPPER_CLOCK		10000 // TIM3 counts / s
+#define CHOPPER_COUNTS_PER_MS	(CHOPPER_CLOCK / 1000)
+#define MAX_CHOPPER_PERIOD_MS	(0xffff / CHOPPER_COUNTS_PER_MS)
+
+#if AUDIO_WAVETABLE_OUTPUT
+#define SAMPLE_RATE		40000
+#define ENVELOPE_TICKS_PER_MS	(SAMPLE_RATE / 1000) // samples
+#else
+#define ENVELOPE_TICKS_PER_MS	(SIGNAL_PERIOD_BASE_VALUE * 2 / 1000) // timer counts
+#endif
 
 TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim3;
 
-uint16_t sound_period_length = 1200;
 uint8_t amplitude = 0;
 
-ROM uint8_t LOUDNESS_BITS[]=
-{
-    0,
-    0b00111110,
-    0b01111110,
-    0b10011110,
-    0b10111110,
-    0b11001110,
-    0b11011110,
-    0b11100110,
-    0b11101110,
-    0b11110010,
-    0b11110110,
-    0b11111000,
-    0b11111010,
-    0b11111100,
-    0b11111110
-};
-//!< set volume using log multiplying DAC
-void set_volume( uint16_t volume)
-{
-  uint32_t odr = GPIOA->ODR; // read and conserve bits > bit 7
-  odr &= ~0xff;
-  if( volume > 14)
-    volume = 14;
-  odr |= LOUDNESS_BITS[volume];
-  GPIOA->ODR = odr;
-}
-
-//!< activate or deactivate sound timer
-void sound_on( bool activated)
-{
-  if( activated)
+static envelope_generator envelope; //!< one ladder: shared by both voices
+static voice_routing routing; //!< voice requests -> ladder targets and channel voices
+static uint8_t ladder_code;
+static chirp_generator <ENVELOPE_TICKS_PER_MS> sweep; //!< vario voice glide, advanced by the audio ISR
+
+//! GPIOA->BSRR value selecting a ladder code
+static inline uint32_t ladder_bsrr( unsigned code)
+{
+  uint32_t bits = LOUDNESS_BITS[code] & LADDER_PINS;
+  return bits | ((LADDER_PINS & ~bits) << 16);
+}
+
+#if AUDIO_VOLUME_DITHERING
+
+#if ACTIVATE_USART_2 && USART_DMA
+#error "volume dithering needs DMA1 channel 7 (USART2 TX)"
+#endif
+
+#define DITHER_BITS		4
+#define DITHER_SLOTS		(1 << DITHER_BITS)
+#define DITHER_CLOCK		576000 // BSRR writes / s -> pattern repeats @ 36 kHz
+
+//! slot order spreading the upper code evenly over the pattern (bit reversal)
+CONSTEXPR_ROM uint8_t DITHER_ORDER[DITHER_SLOTS] =
+  { 0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15 };
+
+TIM_HandleTypeDef htim4;
+static DMA_HandleTypeDef hdma_tim4_up;
+static uint32_t dither_pattern[DITHER_SLOTS]; //!< circular DMA source -> GPIOA->BSRR
+static uint8_t ladder_step; //!< ladder code * DITHER_SLOTS + fraction
+
+//!< drive the log multiplying DAC, to be called from the audio ISR only
+static inline void write_ladder( uint16_t level)
+{
+  uint8_t step = level >> (8 - DITHER_BITS);
+  if( step == ladder_step)
+    return;
+  ladder_step = step;
+  ladder_code = level >> 8;
+
+  // the DMA keeps reading: a half-updated pattern lasts for one pattern period only
+  unsigned fraction = step & (DITHER_SLOTS - 1);
+  uint32_t lower = ladder_bsrr( ladder_code);
+  uint32_t upper = fraction ? ladder_bsrr( ladder_code + 1) : lower;
+  for( unsigned i=0; i < DITHER_SLOTS; ++i)
+    dither_pattern[i] = DITHER_ORDER[i] < fraction ? upper : lower;
+}
+
+//!< TIM4 update requests copy the pattern to GPIOA->BSRR via DMA1 channel 7
+static void init_ladder( void)
+{
+  ladder_step = 0xff;
+  write_ladder( 0);
+  GPIOA->BSRR = dither_pattern[0];
+
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  __HAL_RCC_TIM4_CLK_ENABLE();
+
+  hdma_tim4_up.Instance                 = DMA1_Channel7;
+  hdma_tim4_up.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma_tim4_up.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_tim4_up.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_tim4_up.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  hdma_tim4_up.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+  hdma_tim4_up.Init.Mode                = DMA_CIRCULAR;
+  hdma_tim4_up.Init.Priority            = DMA_PRIORITY_LOW;
+  if (HAL_DMA_Init(&hdma_tim4_up) != HAL_OK)
+    Error_Handler();
+  if( HAL_DMA_Start( &hdma_tim4_up, (uint32_t)dither_pattern, (uint32_t)&(GPIOA->BSRR), DITHER_SLOTS) != HAL_OK)
+    Error_Handler();
+
+  htim4.Instance = TIM4;
+  htim4.Init.Prescaler = 0;
+  htim4.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim4.Init.Period = TIMER_CLOCK / DITHER_CLOCK - 1;
+  htim4.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim4.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  if (HAL_TIM_Base_Init(&htim4) != HAL_OK)
+    Error_Handler();
+
+  __HAL_TIM_ENABLE_DMA( &htim4, TIM_DMA_UPDATE);
+  if (HAL_TIM_Base_Start(&htim4) != HAL_OK)
+    Error_Handler();
+}
+
+#else
+
+//!< drive the log multiplying DAC, to be called from the audio ISR only
+static inline void write_ladder( uint16_t level)
+{
+  uint8_t code = level >> 8;
+  if( code == ladder_code)
+    return;
+  ladder_code = code;
+
+  GPIOA->BSRR = ladder_bsrr( code);
+}
+
+static void init_ladder( void)
+{
+  ladder_code = 0xff;
+  write_ladder( 0);
+}
+
+#endif // AUDIO_VOLUME_DITHERING
+
+#if AUDIO_WAVETABLE_OUTPUT
+
+static chopper_cadence <SAMPLE_RATE / 1000> cadence; //!< advanced per sample by fill_samples()
+
+//! vario voice audible at the next sample, for the audio ISR
+static inline bool vario_gate_open( void)
+{
+  return cadence.is_open();
+}
+
+//!< gate the vario voice: on for on_ms out of every period_ms
+void set_chopper( uint16_t period_ms, uint16_t on_ms)
+{
+  chopper_timing( period_ms, on_ms, MAX_CHOPPER_PERIOD_MS);
+  cadence.set( period_ms, on_ms);
+}
+
+#else // TIM2 toggle output
+
+#if ACTIVATE_USART_2 && USART_DMA
+#error "the chopper gate needs DMA1 channel 6 (USART2 RX)"
+#endif
+
+#define GATE_CLOSED		0
+#define GATE_OPEN		1
+#define GATE_CLOSED_TAG		TIM_CCMR1_OC1FE // no effect in toggle and forced mode
+
+static uint16_t chopper_period_ms; //!< 0 = continuous tone
+static uint16_t chopper_on_ms;
+
+//! TIM2->CCMR1 output compare mode per channel
+static constexpr uint32_t ccmr1_image( uint32_t ch1_mode, uint32_t ch2_mode)
+{
+  return ch1_mode | (ch2_mode << 8);
+}
+
+//! TIM2->CCMR1 images, copied by DMA on the TIM3 compare (close) and update (open) events
+static uint32_t gate_image[2] =
+  {
+    ccmr1_image( TIM_OCMODE_FORCED_INACTIVE, TIM_OCMODE_FORCED_INACTIVE) | GATE_CLOSED_TAG,
+    ccmr1_image( TIM_OCMODE_TOGGLE, TIM_OCMODE_TOGGLE)
+  };
+static DMA_HandleTypeDef hdma_tim3_ch1;
+static DMA_HandleTypeDef hdma_tim3_up;
+
+//! the gate state left by the last TIM3 event, for the audio ISR
+static inline bool vario_gate_open( void)
+{
+  return (TIM2->CCMR1 & GATE_CLOSED_TAG) == 0;
+}
+
+/*! write TIM2->CCMR1 matching the gate state, the TIM3 DMA keeps running
+ *
+ * A TIM3 event while we are at it leaves its flag: then its state
+ * is the valid one, and CCMR1 is written once more.
+ * The shortest cadence phase is orders of magnitude longer than the loop. */
+static void resync_gate( void)
+{
+  if( chopper_period_ms == 0)
+    {
+      TIM2->CCMR1 = gate_image[GATE_OPEN];
+      return;
+    }
+
+  __disable_irq(); // the audio ISR is above the RTOS critical section
+  bool open = vario_gate_open();
+  uint32_t events;
+  do
+    {
+      TIM3->SR = ~(TIM_SR_CC1IF | TIM_SR_UIF);
+      TIM2->CCMR1 = gate_image[open ? GATE_OPEN : GATE_CLOSED];
+      events = TIM3->SR & (TIM_SR_CC1IF | TIM_SR_UIF);
+      if( events)
+	open = (events & TIM_SR_UIF) != 0;
+    }
+  while( events);
+  __enable_irq();
+}
+
+//!< gate the vario voice: on for on_ms out of every period_ms
+void set_chopper( uint16_t period_ms, uint16_t on_ms)
+{
+  chopper_timing( period_ms, on_ms, MAX_CHOPPER_PERIOD_MS);
+  if( (period_ms == chopper_period_ms) && (on_ms == chopper_on_ms))
+    return;
+
+  bool was_continuous = (chopper_period_ms == 0);
+  chopper_period_ms = period_ms;
+  chopper_on_ms = on_ms;
+
+  if( period_ms == 0)
+    {
+      TIM3->DIER &= ~(TIM_DIER_CC1DE | TIM_DIER_UDE);
+      TIM2->CCMR1 = gate_image[GATE_OPEN]; // continuous tone right now
+      return;
+    }
+
+  // ARR and CCR1 are preloaded: a running cadence changes at its period end
+  TIM3->ARR  = period_ms * CHOPPER_COUNTS_PER_MS - 1;
+  TIM3->CCR1 = on_ms * CHOPPER_COUNTS_PER_MS;
+
+  if( was_continuous)
+    {
+      __disable_irq(); // the gate is open, no compare event must pass unseen
+      TIM3->EGR = TIM_EGR_UG; // load ARR + CCR1, start with the on phase
+      TIM3->SR = ~(TIM_SR_CC1IF | TIM_SR_UIF);
+      TIM3->DIER |= TIM_DIER_CC1DE | TIM_DIER_UDE;
+      __enable_irq();
+    }
+}
+
+//!< one DMA word per TIM3 event: image -> TIM2->CCMR1
+static void init_gate_dma( DMA_HandleTypeDef &hdma, DMA_Channel_TypeDef *channel, uint32_t *image)
+{
+  hdma.Instance                 = channel;
+  hdma.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma.Init.MemInc              = DMA_MINC_DISABLE;
+  hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  hdma.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+  hdma.Init.Mode                = DMA_CIRCULAR;
+  hdma.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+  if (HAL_DMA_Init(&hdma) != HAL_OK)
+    Error_Handler();
+  if( HAL_DMA_Start( &hdma, (uint32_t)image, (uint32_t)&(TIM2->CCMR1), 1) != HAL_OK)
+    Error_Handler();
+}
+
+//!< TIM3 times the cadence, its compare and update events gate TIM2 by DMA
+static void init_chopper( void)
+{
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_OC_InitTypeDef sConfigOC = {0};
+
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  init_gate_dma( hdma_tim3_ch1, DMA1_Channel6, &gate_image[GATE_CLOSED]);
+  init_gate_dma( hdma_tim3_up,  DMA1_Channel3, &gate_image[GATE_OPEN]);
+
+  __HAL_RCC_TIM3_CLK_ENABLE();
+
+  htim3.Instance = TIM3;
+  htim3.Init.Prescaler = TIMER_CLOCK / CHOPPER_CLOCK - 1;
+  htim3.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim3.Init.Period = 0xffff;
+  htim3.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim3.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  if (HAL_TIM_Base_Init(&htim3) != HAL_OK)
+    Error_Handler();
+
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim3, &sClockSourceConfig) != HAL_OK)
+    Error_Handler();
+
+  if (HAL_TIM_OC_Init(&htim3) != HAL_OK)
+    Error_Handler();
+
+  sConfigOC.OCMode = TIM_OCMODE_TIMING; // compare event only, CC1E stays off (PA6 belongs to the ladder)
+  sConfigOC.Pulse = 0;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  if (HAL_TIM_OC_ConfigChannel(&htim3, &sConfigOC, TIM_CHANNEL_1) != HAL_OK)
+    Error_Handler();
+  TIM3->CCMR1 |= TIM_CCMR1_OC1PE; // CCR1 preload: a new cadence starts at the period end
+
+  // continuous tone for a start: no gate DMA requests before set_chopper()
+  if (HAL_TIM_Base_Start(&htim3) != HAL_OK)
+    Error_Handler();
+}
+
+#endif // AUDIO_WAVETABLE_OUTPUT
+
+//!< let the envelope follow the gate for a soft beep onset, to be called from the audio ISR only
+static inline void follow_vario_gate( void)
+{
+  envelope.set_target( routing.target( vario_gate_open()));
+}
+
+//!< derive ladder target, channel assignment and gating from the voice requests
+static void update_voices( void)
+{
+#if AUDIO_WAVETABLE_OUTPUT
+  routing.update();
+#else
+  audio_voice_t ch1_voice, ch2_voice;
+  bool sounding = routing.assignment( ch1_voice, ch2_voice); // silent: the assignment is kept
+  bool two_voices = ch1_voice != ch2_voice;
+
+  // CC2 interrupts only while CH2 runs its own voice: enabled before
+  // and disabled after the split, the ISR ignores CC2 while both are equal
+  if( sounding && two_voices && ! (TIM2->DIER & TIM_DIER_CC2IE))
+    {
+      TIM2->SR = ~TIM_SR_CC2IF; // stale match from the quadrature phase
+      TIM2->DIER |= TIM_DIER_CC2IE;
+    }
+  routing.update();
+  if( sounding)
+    {
+      if( ! two_voices)
+	TIM2->DIER &= ~TIM_DIER_CC2IE;
+
+      // the cadence switches the channels carrying the vario voice
+      uint32_t closed = ccmr1_image(
+	  ch1_voice == VARIO_VOICE ? TIM_OCMODE_FORCED_INACTIVE : TIM_OCMODE_TOGGLE,
+	  ch2_voice == VARIO_VOICE ? TIM_OCMODE_FORCED_INACTIVE : TIM_OCMODE_TOGGLE) | GATE_CLOSED_TAG;
+      if( closed != gate_image[GATE_CLOSED])
+	{
+	  gate_image[GATE_CLOSED] = closed;
+	  resync_gate();
+	}
+    }
+#endif
+
+  // the audio ISR picks the target according to the cadence
+  envelope.set_target( routing.target( vario_gate_open()));
+}
+
+//!< request volume, the envelope in the audio ISR ramps toward it
+void set_volume( uint16_t volume, audio_voice_t v)
+{
+  routing.set_level( v, ((uint32_t)volume * (MAX_LOUDNESS_LEVEL + 1)) >> 16); // 65535 -> 14 << 8
+  update_voices();
+}
+
+//!< ramp up to the requested volume or down to silence
+void sound_on( bool activated, audio_voice_t v)
+{
+  routing.set_on( v, activated);
+  update_voices();
+}
+
+#if RUN_AUDIO_BENCHMARK
+
+static audio_isr_statistics_t isr_statistics;
+
+//!< copy the audio ISR statistics, optionally start over
+void audio_isr_snapshot( audio_isr_statistics_t &copy, bool reset)
+{
+  __disable_irq(); // the audio ISR is above the RTOS critical section
+  copy = isr_statistics;
+  if( reset)
+    {
+      isr_statistics = audio_isr_statistics_t();
+      isr_statistics.min_gate_period = 0xffffffff;
+    }
+  __enable_irq();
+}
+
+static inline void benchmark_isr_done( uint32_t entry)
+{
+  uint32_t cycles = DWT->CYCCNT - entry;
+  ++isr_statistics.calls;
+  isr_statistics.cycles += cycles;
+  if( cycles > isr_statistics.max_cycles)
+    isr_statistics.max_cycles = cycles;
+}
+
+//!< vario gate state as seen by the audio ISR at DWT time now
+static inline void benchmark_gate( bool open, uint32_t now)
+{
+  static bool was_open;
+  static uint32_t last_opening;
+
+  if( open && ! was_open)
     {
-      if ( HAL_TIM_OC_Start(&htim2, TIM_CHANNEL_1)  != HAL_OK)
-        Error_Handler();
-      if ( HAL_TIM_OC_Start(&htim2, TIM_CHANNEL_2)  != HAL_OK)
-        Error_Handler();
+      if( isr_statistics.gate_openings != 0)
+	{
+	  uint32_t period = now - last_opening;
+	  if( period < isr_statistics.min_gate_period)
+	    isr_statistics.min_gate_period = period;
+	  if( period > isr_statistics.max_gate_period)
+	    isr_statistics.max_gate_period = period;
+	}
+      ++isr_statistics.gate_openings;
+      last_opening = now;
     }
-  else
+  was_open = open;
+}
+
+#endif // RUN_AUDIO_BENCHMARK
+
+#if AUDIO_WAVETABLE_OUTPUT
+
+#define PWM_PERIOD		(TIMER_CLOCK / SAMPLE_RATE) // 1800 counts
+#define PWM_MIDDLE		(PWM_PERIOD / 2)
+#define PWM_AMPLITUDE		(PWM_MIDDLE - 1)
+
+#define SAMPLE_BUFFER_FRAMES	32 // per half buffer -> refill @ 1.25 kHz
+
+static DMA_HandleTypeDef hdma_tim2_up;
+
+//! double buffer, one frame = { CCR1, CCR2 } written by one DMA burst
+static uint16_t sample_buffer[2 * SAMPLE_BUFFER_FRAMES][2];
+
+static dds_oscillator <SAMPLE_RATE> oscillator[AUDIO_VOICES];
+
+//!< compute one half of the sample buffer
+static void fill_samples( uint16_t (*frame)[2])
+{
+  follow_vario_gate();
+  write_ladder( envelope.step( SAMPLE_BUFFER_FRAMES));
+
+  if( sweep.is_active())
+    oscillator[VARIO_VOICE].set_frequency( sweep.step( SAMPLE_BUFFER_FRAMES));
+
+  if( envelope.is_idle())
+    {
+      for( unsigned i=0; i < SAMPLE_BUFFER_FRAMES; ++i)
+	{
+	  cadence.step(); // keeps time in silence, too
+	  frame[i][0] = frame[i][1] = PWM_MIDDLE;
+	}
+      return;
+    }
+
+#if RUN_AUDIO_BENCHMARK
+  benchmark_gate( vario_gate_open(), DWT->CYCCNT);
+#endif
+
+  audio_voice_t ch1_voice = routing.channel( 0);
+  if( ch1_voice == routing.channel( 1)) // one voice on both channels
+    {
+      dds_oscillator <SAMPLE_RATE> &source = oscillator[ch1_voice];
+      bool chopped = ch1_voice == VARIO_VOICE;
+      for( unsigned i=0; i < SAMPLE_BUFFER_FRAMES; ++i)
+	{
+	  int32_t sample = source.step();
+	  if( ! cadence.step() && chopped)
+	    sample = 0;
+	  frame[i][0] = frame[i][1] = PWM_MIDDLE + ((sample * PWM_AMPLITUDE) >> 15);
+	}
+      return;
+    }
+
+  // two voices: the ladder follows the louder one, the other one is scaled down here
+  int32_t amplitude[AUDIO_VOICES];
+  for( unsigned v=0; v < AUDIO_VOICES; ++v)
+    {
+      amplitude[v] = PWM_AMPLITUDE * LADDER_GAIN[routing.get_level( (audio_voice_t)v) >> 8] / LADDER_GAIN[ladder_code];
+      if( amplitude[v] > PWM_AMPLITUDE)
+	amplitude[v] = PWM_AMPLITUDE;
+    }
+
+  for( unsigned i=0; i < SAMPLE_BUFFER_FRAMES; ++i)
     {
-      if ( HAL_TIM_OC_Stop(&htim2, TIM_CHANNEL_1)  != HAL_OK)
-          Error_Handler();
-      if ( HAL_TIM_OC_Stop(&htim2, TIM_CHANNEL_2)  != HAL_OK)
-          Error_Handler();
+      int32_t vario = oscillator[VARIO_VOICE].step() * amplitude[VARIO_VOICE];
+      if( ! cadence.step())
+	vario = 0;
+      frame[i][0] = PWM_MIDDLE + (vario >> 15);
+      frame[i][1] = PWM_MIDDLE + ((oscillator[SIGNAL_VOICE].step() * amplitude[SIGNAL_VOICE]) >> 15);
     }
 }
 
-//!< set frequency using timer TIM2 hardware
-void set_frequency( uint16_t frequency_Hz)
+static void first_half_consumed( DMA_HandleTypeDef *)
+{
+  fill_samples( &sample_buffer[0]);
+}
+
+static void second_half_consumed( DMA_HandleTypeDef *)
+{
+  fill_samples( &sample_buffer[SAMPLE_BUFFER_FRAMES]);
+}
+
+extern "C" void DMA1_Channel2_IRQHandler( void)
+{
+#if RUN_AUDIO_BENCHMARK
+  uint32_t entry = DWT->CYCCNT;
+  HAL_DMA_IRQHandler( &hdma_tim2_up);
+  benchmark_isr_done( entry);
+#else
+  HAL_DMA_IRQHandler( &hdma_tim2_up);
+#endif
+}
+
+//!< set frequency of the voice's DDS oscillator, phase-continuous
+void set_frequency( uint16_t frequency_Hz, audio_voice_t v)
 {
   if( frequency_Hz == 0)
     return;
+  if( v == VARIO_VOICE)
+    sweep.cancel();
+  oscillator[v].set_frequency( frequency_Hz);
+}
 
-  unsigned count = SIGNAL_PERIOD_BASE_VALUE / frequency_Hz;
-  // count = 12000 -> 1kHz
-  TIM2->ARR = count;
-  TIM2->CCR1 = count/2;
+//!< select a waveform of DDS_TABLE_SIZE samples (may reside in ROM)
+void set_waveform( const int16_t *table)
+{
+  for( unsigned v=0; v < AUDIO_VOICES; ++v)
+    oscillator[v].set_waveform( table);
+}
+
+//!< initialize TIM2 as PWM DAC fed by DMA1 channel 2 (TIM2_UP)
+void init_pieps( void)
+{
+  __HAL_RCC_GPIOA_CLK_ENABLE();
+  __HAL_RCC_AFIO_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  GPIO_InitStruct.Pin = GPIO_PIN_0 | GPIO_PIN_1;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+  GPIO_InitStruct.Pin = 0xff - (GPIO_PIN_0 | GPIO_PIN_1);
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+  init_ladder();
+  set_envelope( ATTACK_TIME_MS, RELEASE_TIME_MS);
+
+  fill_samples( &sample_buffer[0]);
+  fill_samples( &sample_buffer[SAMPLE_BUFFER_FRAMES]);
+
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_OC_InitTypeDef sConfigOC = {0};
+
+  __HAL_RCC_TIM2_CLK_ENABLE();
+
+  htim2.Instance = TIM2;
+  htim2.Init.Prescaler = 0;
+  htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim2.Init.Period = PWM_PERIOD - 1;
+  htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
+    Error_Handler();
+
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim2, &sClockSourceConfig) != HAL_OK)
+    Error_Handler();
+
+  if (HAL_TIM_PWM_Init(&htim2) != HAL_OK)
+    Error_Handler();
+
+  sConfigOC.OCMode = TIM_OCMODE_PWM1; // CCR preload is enabled by HAL
+  sConfigOC.Pulse = PWM_MIDDLE;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  if (HAL_TIM_PWM_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_1) != HAL_OK)
+      Error_Handler();
+  if (HAL_TIM_PWM_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_2) != HAL_OK)
+      Error_Handler();
+
+  hdma_tim2_up.Instance                 = DMA1_Channel2;
+  hdma_tim2_up.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma_tim2_up.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_tim2_up.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_tim2_up.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_tim2_up.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+  hdma_tim2_up.Init.Mode                = DMA_CIRCULAR;
+  hdma_tim2_up.Init.Priority            = DMA_PRIORITY_HIGH;
+  if (HAL_DMA_Init(&hdma_tim2_up) != HAL_OK)
+    Error_Handler();
+
+  hdma_tim2_up.XferHalfCpltCallback = first_half_consumed;
+  hdma_tim2_up.XferCpltCallback     = second_half_consumed;
+
+  HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, AUDIO_ISR_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+
+  // each update event: DMA burst of 2 half-words into CCR1, CCR2
+  TIM2->DCR = TIM_DMABASE_CCR1 | TIM_DMABURSTLENGTH_2TRANSFERS;
+  if( HAL_DMA_Start_IT( &hdma_tim2_up, (uint32_t)sample_buffer, (uint32_t)&(TIM2->DMAR),
+			 2 * 2 * SAMPLE_BUFFER_FRAMES) != HAL_OK)
+    Error_Handler();
+  __HAL_TIM_ENABLE_DMA( &htim2, TIM_DMA_UPDATE);
+
+  if ( HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_1)  != HAL_OK)
+    Error_Handler();
+  if ( HAL_TIM_PWM_Start(&htim2, TIM_CHANNEL_2)  != HAL_OK)
+    Error_Handler();
+}
+
+#else // TIM2 toggle output
+
+#define TONE_TIMER_CLOCK	(TIMER_CLOCK / 3) // prescaler 2
+
+retune_statistics_t retune_statistics;
+static toggle_periods periods( retune_statistics); //!< half period per voice / timer counts
+
+//!< set voice frequency, taken over by the audio ISR at the next toggle
+void set_frequency( uint16_t frequency_Hz, audio_voice_t v)
+{
+  if( frequency_Hz == 0)
+    return;
+  if( v == VARIO_VOICE)
+    sweep.cancel();
+  periods.retune( v, frequency_Hz);
+}
+
+//!< TIM2 compare: schedule the next toggle per channel, run the envelope
+extern "C" void TIM2_IRQHandler( void)
+{
+#if RUN_AUDIO_BENCHMARK
+  uint32_t entry = DWT->CYCCNT;
+  uint16_t latency = TIM2->CNT - TIM2->CCR1;
+#endif
+  uint32_t status = TIM2->SR;
+  TIM2->SR = ~(status & (TIM_SR_CC1IF | TIM_SR_CC2IF));
+
+  audio_voice_t ch1_voice = routing.channel( 0);
+  audio_voice_t ch2_voice = routing.channel( 1);
+
+  if( status & TIM_SR_CC1IF)
+    {
+      uint32_t period = periods.next( ch1_voice, sweep);
+#if RUN_AUDIO_BENCHMARK
+      if( latency > isr_statistics.max_latency)
+	isr_statistics.max_latency = latency;
+      if( ch1_voice == VARIO_VOICE)
+	{
+	  ++isr_statistics.vario_half_periods;
+	  isr_statistics.vario_counts += period;
+	}
+#endif
+      uint16_t next = TIM2->CCR1 + period;
+      TIM2->CCR1 = next;
+      if( ch2_voice == ch1_voice) // one voice on both pins: CH2 in quadrature
+	TIM2->CCR2 = (uint16_t)( next - period / 2);
+
+      follow_vario_gate();
+      write_ladder( envelope.step( period));
+#if RUN_AUDIO_BENCHMARK
+      benchmark_gate( vario_gate_open(), entry);
+#endif
+
+      // the timer keeps running, silence = outputs disabled, the cadence is gated by DMA
+      uint32_t enable = envelope.is_idle() ? 0 : TIM_CCER_CC1E | TIM_CCER_CC2E;
+      TIM2->CCER = (TIM2->CCER & ~(TIM_CCER_CC1E | TIM_CCER_CC2E)) | enable;
+    }
+
+  if( (status & TIM_SR_CC2IF) && (ch2_voice != ch1_voice))
+    TIM2->CCR2 = (uint16_t)( TIM2->CCR2 + periods.next( ch2_voice, sweep));
+#if RUN_AUDIO_BENCHMARK
+  benchmark_isr_done( entry);
+#endif
 }
 
 //!< initialize the TIM2 sound output module
@@ -124,6 +764,9 @@ void init_pieps( void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
   HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+  init_ladder();
+  set_envelope( ATTACK_TIME_MS, RELEASE_TIME_MS);
+
   TIM_ClockConfigTypeDef sClockSourceConfig = {0};
   TIM_MasterConfigTypeDef sMasterConfig = {0};
   TIM_OC_InitTypeDef sConfigOC = {0};
@@ -131,9 +774,9 @@ void init_pieps( void)
   __HAL_RCC_TIM2_CLK_ENABLE();
 
   htim2.Instance = TIM2;
-  htim2.Init.Prescaler = 2;
+  htim2.Init.Prescaler = TIMER_CLOCK / TONE_TIMER_CLOCK - 1;
   htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim2.Init.Period = sound_period_length;
+  htim2.Init.Period = 0xffff; // free running, each channel schedules its own toggles
   htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
   htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
   if (HAL_TIM_Base_Init(&htim2) != HAL_OK)
@@ -151,55 +794,47 @@ void init_pieps( void)
   if (HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK)
     Error_Handler();
 
+  // CCR preload stays off: the ISR moves the compare point ahead of the counter
   sConfigOC.OCMode = TIM_OCMODE_TOGGLE;
-  sConfigOC.Pulse = 0;
+  sConfigOC.Pulse = periods.get( VARIO_VOICE);
   sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
 
   sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
   if (HAL_TIM_OC_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_1) != HAL_OK)
       Error_Handler();
+  sConfigOC.Pulse = periods.get( VARIO_VOICE) / 2;
   if (HAL_TIM_OC_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_2) != HAL_OK)
       Error_Handler();
 
+  init_chopper();
+
+  __HAL_TIM_CLEAR_FLAG( &htim2, TIM_FLAG_CC1 | TIM_FLAG_CC2);
+  __HAL_TIM_ENABLE_IT( &htim2, TIM_IT_CC1); // CC2: update_voices() while two voices sound
+  HAL_NVIC_SetPriority(TIM2_IRQn, AUDIO_ISR_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(TIM2_IRQn);
+
   if ( HAL_TIM_OC_Start(&htim2, TIM_CHANNEL_1)  != HAL_OK)
     Error_Handler();
   if ( HAL_TIM_OC_Start(&htim2, TIM_CHANNEL_2)  != HAL_OK)
     Error_Handler();
 }
 
-#if RUN_AUDIO_TEST
+#endif // AUDIO_WAVETABLE_OUTPUT
 
-void pieps( void *)
+//!< glide the vario voice, the audio ISR advances the sweep, set_frequency() cancels it
+void sweep_frequency( uint16_t start_Hz, uint16_t stop_Hz, uint32_t rate_Hz_per_s)
 {
-  init_pieps();
-
-  uint16_t amplitude = 0;
-  uint8_t vibrato_count = 0;
-  uint16_t frequency = 250; // Hz
-
-  for( Synchronous_Timer t( 10); true; t.sync())
-    {
-#if 0 // vibrato
-      set_frequency( frequency);
-      set_volume( amplitude);
-      sound_on( vibrato_count & 4);
-#else
-      set_frequency( frequency + ((vibrato_count & 2) ? 20 : 0));
-      set_volume( amplitude);
+#if ! AUDIO_WAVETABLE_OUTPUT
+  periods.cancel( VARIO_VOICE); // no retune after the sweep
 #endif
-      ++vibrato_count;
-      frequency += 10;
-
-      if( frequency > 3000)
-	{
-	frequency = 250;
-	amplitude += 8192;
-	if( amplitude >= 32678)
-		amplitude = 0;
-	}
-    }
+  sweep.arm( start_Hz, stop_Hz, rate_Hz_per_s);
+  update_voices();
 }
 
-Task pieps_task( pieps, "PIEPS");
-
-#endif
+//!< configure the ramp times for a full-scale volume change
+void set_envelope( uint16_t attack_ms, uint16_t release_ms)
+{
+  envelope.configure(
+      envelope_generator::slope( MAX_LOUDNESS_LEVEL, attack_ms * ENVELOPE_TICKS_PER_MS),
+      envelope_generator::slope( MAX_LOUDNESS_LEVEL, release_ms * ENVELOPE_TICKS_PER_MS));
+}
@@ -8,9 +8,60 @@
 #ifndef PIEPS_H_
 #define PIEPS_H_
 
+//! two voices mixed by the resistor network: PA0 -> vario, PA1 -> signal
+enum audio_voice_t
+{
+  VARIO_VOICE,	//!< vario / speed commander, gated by the chopper
+  SIGNAL_VOICE,	//!< alarms and signals, never chopped
+  AUDIO_VOICES
+};
+
+#define VOLUME_PER_STEP		4681 // 16 bit volume per loudness step, 14 steps = 65534
+
+//! 16 bit volume for loudness steps 0 .. 14 (15 ladder codes)
+inline uint16_t step_volume( uint16_t steps)
+{
+  return steps >= 14 ? 0xffff : steps * VOLUME_PER_STEP;
+}
+
 void init_pieps(void); 		//!< initialize sound hardware
-void sound_on( bool yes); 	//!< switch sound on | off
-void set_frequency( uint16_t frequency_Hz); 	//!< set sound frequency / Hz
-void set_volume( uint16_t volume);		//!< set sound volume 8 log steps, max=65536
+void sound_on( bool yes, audio_voice_t voice = VARIO_VOICE); 	//!< switch voice on | off, ramped by the envelope
+void set_frequency( uint16_t frequency_Hz, audio_voice_t voice = VARIO_VOICE); 	//!< set voice frequency / Hz
+void set_volume( uint16_t volume, audio_voice_t voice = VARIO_VOICE);		//!< set voice volume 16 bit logarithmic, max=65535
+void sweep_frequency( uint16_t start_Hz, uint16_t stop_Hz, uint32_t rate_Hz_per_s); //!< vario voice glide, set_frequency() cancels it
+void set_envelope( uint16_t attack_ms, uint16_t release_ms); //!< ramp times for full-scale changes
+void set_chopper( uint16_t period_ms, uint16_t on_ms); //!< vario voice on/off cadence, period 0 = continuous
+
+#if AUDIO_WAVETABLE_OUTPUT
+void set_waveform( const int16_t *table); 	//!< select one period of DDS_TABLE_SIZE samples
+#else
+//! TIM2 retune bookkeeping, new periods are committed at the next toggle
+typedef struct
+{
+  uint32_t deferred;	//!< retunes staged for the next toggle
+  uint32_t coalesced;	//!< staged retunes replaced before being committed
+  uint32_t applied;	//!< retunes written into the timer
+} retune_statistics_t;
+
+extern retune_statistics_t retune_statistics;
+#endif
+
+#if RUN_AUDIO_BENCHMARK
+//! audio ISR measurements, DWT cycles unless noted
+typedef struct
+{
+  uint32_t calls;
+  uint32_t cycles;		//!< spent in the audio ISR
+  uint32_t max_cycles;
+  uint32_t max_latency;		//!< toggle mode: TIM2 counts from compare match to ISR entry
+  uint32_t vario_half_periods;	//!< toggle mode: vario toggles scheduled
+  uint32_t vario_counts;	//!< toggle mode: sum of their half periods / TIM2 counts
+  uint32_t gate_openings;	//!< vario gate off -> on seen by the ISR
+  uint32_t min_gate_period;	//!< between two openings
+  uint32_t max_gate_period;
+} audio_isr_statistics_t;
+
+void audio_isr_snapshot( audio_isr_statistics_t &copy, bool reset); //!< read, optionally start over
+#endif
 
 #endif /* PIEPS_H_ */
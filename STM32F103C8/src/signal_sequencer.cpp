@@ -0,0 +1,104 @@
+/**
+ * @file    signal_sequencer.cpp
+ * @brief   Melody tables for the signals sent via c_CID_A57_Signal
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include "embedded_memory.h"
+#include "Generic_CAN_Ids.h"
+#include "signal_sequencer.h"
+
+ROM signal_note_t startup_notes[] =
+{
+    {    0, 1000,  0 },
+    {  500,  333, 14 },
+    {  630,  333, 14 },
+    {  749,  333, 14 },
+    { 1000,  666, 14 },
+    {    0, 2000,  0 },
+    {    0,    0,  0 }
+};
+
+ROM signal_note_t auto_change_notes[] =
+{
+    {  600,  100, 10 },
+    {  900,  100, 10 },
+    {    0,    0,  0 }
+};
+
+ROM signal_note_t inv_auto_change_notes[] =
+{
+    {  900,  100, 10 },
+    {  600,  100, 10 },
+    {    0,    0,  0 }
+};
+
+ROM signal_note_t alarm_notes[] =
+{
+    { 1500,  150, 14 },
+    { 1000,  150, 14 },
+    { 1500,  150, 14 },
+    { 1000,  150, 14 },
+    { 1500,  150, 14 },
+    { 1000,  150, 14 },
+    {    0,    0,  0 }
+};
+
+ROM signal_note_t transfer_notes[] =
+{
+    {  800,   80, 12 },
+    {    0,   40,  0 },
+    { 1200,   80, 12 },
+    {    0,    0,  0 }
+};
+
+ROM signal_note_t click_notes[] =
+{
+    { 2000,   10, 10 },
+    {    0,    0,  0 }
+};
+
+ROM signal_note_t beep_notes[] =
+{
+    { 1000,  100, 12 },
+    {    0,    0,  0 }
+};
+
+ROM signal_melody_t startup_melody = { startup_notes, 255, true };
+
+//! melodies indexed by CAN_SIGNAL_IDs
+ROM signal_melody_t signal_melodies[cmaxSigId] =
+{
+    { 0,                     0, false }, // cNoSignal
+    { auto_change_notes,     1, false }, // cAutoChange
+    { inv_auto_change_notes, 1, false }, // cInvAutoChange
+    { alarm_notes,           3, true  }, // cAlarm
+    { transfer_notes,        2, false }, // cTransfer
+    { click_notes,           1, false }, // cClick
+    { beep_notes,            1, false }, // cBeep
+};
+
+bool signal_sequencer::start( unsigned signal_id, uint8_t signal_volume, uint32_t now_ms)
+{
+  if( signal_id >= cmaxSigId)
+    return false;
+  return start( signal_melodies[signal_id], signal_volume, now_ms);
+}
@@ -0,0 +1,164 @@
+/**
+ * @file    signal_sequencer.h
+ * @brief   Non-blocking player for the signal melodies (alarm, click, beep ...)
+ *
+ * Plain C++ without any HAL dependency.
+ * A melody is a ROM table of notes terminated by a note of duration 0.
+ * The sequencer never waits itself: the caller asks for the next
+ * deadline, sleeps until then and calls update() with the current time.
+ * Note ends are accumulated from the melody start, so the melody does
+ * not drift if the caller wakes up late.
+ *
+ * Signals sound on their own voice (pieps.h). Pre-empting melodies
+ * silence the vario tone until they have finished, ducking melodies
+ * let the vario continue at reduced volume underneath.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIGNAL_SEQUENCER_H_
+#define SIGNAL_SEQUENCER_H_
+
+#include <stdint.h>
+
+#define SIGNAL_MAX_VOLUME	14 // loudness steps, see step_volume()
+#define SIGNAL_DUCK_STEPS	4  // vario attenuation during a ducking melody
+
+typedef struct
+{
+  uint16_t frequency;	//!< Hz, 0 = pause
+  uint16_t duration;	//!< ms, 0 = end of melody
+  uint8_t volume;	//!< loudness step 0 .. SIGNAL_MAX_VOLUME
+} signal_note_t;
+
+typedef struct
+{
+  const signal_note_t *notes;	//!< 0 = no melody
+  uint8_t priority;		//!< a running melody is only replaced by equal or higher priority
+  bool preempt;			//!< true: vario silent, false: vario ducked
+} signal_melody_t;
+
+//! power-up melody, starts with a pause to let the supply settle
+extern const signal_melody_t startup_melody;
+
+class signal_sequencer
+{
+public:
+  signal_sequencer( void)
+  : melody( 0),
+    note( 0),
+    note_end( 0),
+    volume( 0)
+  {}
+
+  //! start melody with signal_volume 1..SIGNAL_MAX_VOLUME, 0 = as written
+  bool start( const signal_melody_t &new_melody, uint8_t signal_volume, uint32_t now_ms)
+  {
+    if( (new_melody.notes == 0) || (new_melody.notes->duration == 0))
+      return false;
+    if( is_active() && (new_melody.priority < melody->priority))
+      return false;
+
+    melody = &new_melody;
+    note = new_melody.notes;
+    note_end = now_ms + note->duration;
+    volume = signal_volume > SIGNAL_MAX_VOLUME ? SIGNAL_MAX_VOLUME : signal_volume;
+    return true;
+  }
+
+  //! start melody number signal_id from the CAN_SIGNAL_IDs table
+  bool start( unsigned signal_id, uint8_t signal_volume, uint32_t now_ms);
+
+  //! advance to the note due at now_ms, return true if the note changed
+  bool update( uint32_t now_ms)
+  {
+    if( note == 0)
+      return false;
+
+    bool changed = false;
+    while( (int32_t)(now_ms - note_end) >= 0)
+      {
+	++note;
+	changed = true;
+	if( note->duration == 0)
+	  {
+	    melody = 0;
+	    note = 0;
+	    break;
+	  }
+	note_end += note->duration;
+      }
+    return changed;
+  }
+
+  bool is_active( void) const
+  {
+    return note != 0;
+  }
+
+  //! true if a note (not a pause) is playing
+  bool is_sounding( void) const
+  {
+    return (note != 0) && (note->frequency != 0);
+  }
+
+  bool preempts_vario( void) const
+  {
+    return (melody != 0) && melody->preempt;
+  }
+
+  //! time when update() has to be called next
+  uint32_t get_deadline( void) const
+  {
+    return note_end;
+  }
+
+  uint16_t get_frequency( void) const
+  {
+    return note ? note->frequency : 0;
+  }
+
+  uint16_t get_volume( void) const
+  {
+    if( note == 0)
+      return 0;
+    if( volume == 0)
+      return note->volume;
+    return (note->volume * volume + SIGNAL_MAX_VOLUME / 2) / SIGNAL_MAX_VOLUME;
+  }
+
+  //! vario volume while a ducking melody plays
+  static uint16_t duck( uint16_t vario_volume)
+  {
+    if( vario_volume > SIGNAL_MAX_VOLUME)
+      vario_volume = SIGNAL_MAX_VOLUME;
+    if( vario_volume <= SIGNAL_DUCK_STEPS)
+      return vario_volume ? 1 : 0;
+    return vario_volume - SIGNAL_DUCK_STEPS;
+  }
+
+private:
+  const signal_melody_t *melody;
+  const signal_note_t *note;
+  uint32_t note_end;	//!< ms
+  uint8_t volume;	//!< 0 = note volume as written
+};
+
+#endif /* SIGNAL_SEQUENCER_H_ */
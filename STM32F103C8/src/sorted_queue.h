@@ -0,0 +1,104 @@
+/**
+ * @file    sorted_queue.h
+ * @brief   Bounded queue delivering the item of highest priority first
+ *
+ * Plain C++ without any HAL or RTOS dependency, no locking:
+ * the caller provides the critical section.
+ * type::operator< means "higher priority" (for CAN_packet: smaller ID).
+ * Items of equal priority leave in insertion order.
+ * The items are kept sorted, highest priority at the end: removing the
+ * next item costs nothing, inserting moves the items of lower priority.
+ * Meant for short queues of small items.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SORTED_QUEUE_H_
+#define SORTED_QUEUE_H_
+
+template <class type, unsigned SIZE> class sorted_queue
+{
+public:
+  sorted_queue( void)
+  : count( 0)
+  {}
+
+  bool is_empty( void) const
+  {
+    return count == 0;
+  }
+  bool is_full( void) const
+  {
+    return count >= SIZE;
+  }
+  unsigned get_count( void) const
+  {
+    return count;
+  }
+
+  //! next item to leave, queue must not be empty
+  const type &front( void) const
+  {
+    return item[count - 1];
+  }
+
+  //! item of lowest priority, queue must not be empty
+  const type &back( void) const
+  {
+    return item[0];
+  }
+
+  //! false if full
+  bool insert( const type &x)
+  {
+    if( count >= SIZE)
+      return false;
+    unsigned i = count;
+    while( (i > 0) && ! (x < item[i - 1])) // behind items of higher or same priority
+      {
+	item[i] = item[i - 1];
+	--i;
+      }
+    item[i] = x;
+    ++count;
+    return true;
+  }
+
+  void pop_front( void)
+  {
+    if( count > 0)
+      --count;
+  }
+
+  void pop_back( void)
+  {
+    if( count == 0)
+      return;
+    --count;
+    for( unsigned i = 0; i < count; ++i)
+      item[i] = item[i + 1];
+  }
+
+private:
+  type item[SIZE];	//!< ascending priority
+  unsigned count;
+};
+
+#endif /* SORTED_QUEUE_H_ */
@@ -0,0 +1,101 @@
+/**
+ * @file    spsc_ring.h
+ * @brief   Lock-free single-producer single-consumer ring buffer
+ *
+ * Plain C++ without any HAL or RTOS dependency.
+ * One writer (typically an ISR) and one reader (one task) only.
+ * Each side owns its index and publishes it with release semantics,
+ * so neither side needs a critical section. The indices run freely,
+ * SIZE must be a power of two.
+ * The statistics are written by the producer only.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stdint.h>
+
+template <class type, unsigned SIZE> class spsc_ring
+{
+  static_assert( (SIZE & (SIZE - 1)) == 0, "ring size must be a power of two");
+public:
+  spsc_ring( void)
+  : head( 0),
+    tail( 0),
+    pushed( 0),
+    dropped( 0),
+    high_water( 0)
+  {}
+
+  //! producer side, false if full: the item is dropped
+  bool push( const type &item)
+  {
+    uint32_t h = head;
+    uint32_t fill = h - __atomic_load_n( &tail, __ATOMIC_ACQUIRE);
+    if( fill >= SIZE)
+      {
+	++dropped;
+	return false;
+      }
+    buffer[h & (SIZE - 1)] = item;
+    __atomic_store_n( &head, h + 1, __ATOMIC_RELEASE);
+
+    ++pushed;
+    if( fill + 1 > high_water)
+      high_water = fill + 1;
+    return true;
+  }
+
+  //! consumer side, false if empty
+  bool pop( type &item)
+  {
+    uint32_t t = tail;
+    if( __atomic_load_n( &head, __ATOMIC_ACQUIRE) == t)
+      return false;
+    item = buffer[t & (SIZE - 1)];
+    __atomic_store_n( &tail, t + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  uint32_t get_pushed( void) const
+  {
+    return pushed;
+  }
+  uint32_t get_dropped( void) const
+  {
+    return dropped;
+  }
+  uint32_t get_high_water( void) const //!< max. items waiting
+  {
+    return high_water;
+  }
+
+private:
+  type buffer[SIZE];
+  uint32_t head;	//!< written by the producer only
+  uint32_t tail;	//!< written by the consumer only
+  uint32_t pushed;
+  uint32_t dropped;
+  uint32_t high_water;
+};
+
+#endif /* SPSC_RING_H_ */
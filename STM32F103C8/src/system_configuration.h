@@ -27,14 +27,21 @@ extern uint16_t unique_id_hash;
 #define LED_PORT_CLOCK_ENABLE() __HAL_RCC_GPIOC_CLK_ENABLE()
 #endif
 
-#define RUN_AUDIO_TEST		0
 #define RUN_AUDIO_CONTROLLER	1
+#define AUDIO_WAVETABLE_OUTPUT	0 // 1: DMA-fed PWM sample output, 0: TIM2 toggle output
+#define AUDIO_VOLUME_DITHERING	1 // 1: TIM4 + DMA dither between adjacent ladder codes
+#define REPORT_AUDIO_LATENCY	1 // c_CID_AUD_Latency once per second
+#define RUN_AUDIO_BENCHMARK	0 // scripted self-test on c_CID_AUD_Benchmark_CMD, bench use only
+#define LOCAL_VARIO_FALLBACK	1 // vario from c_CID_KSB_* if c_CID_A57_Audio is missing
 #define ACTIVATE_OAT_SENSOR	0
+#define ACTIVATE_BARO_VARIO	0 // 50 Hz pressure stream -> backup vario, needs the OAT sensor
 #define RUN_BUTTON		0
 
 #define ACTIVATE_CAN 		1
 #define CAN_OPEN_DRAIN		0
 #define CAN_PB8_PB9		1
+#define CAN_STATISTICS_PERIOD_MS 1000 // c_CID_AUD_CAN_Statistics, 0 = off
+#define CAN_BUS_LOAD_MONITOR	0 // 1: no hardware filters, count the whole traffic
 #define RUN_CAN_TRANSMITTER	0
 #define RUN_CAN_RECEIVER	0
 
@@ -0,0 +1,106 @@
+/**
+ * @file    toggle_periods.h
+ * @brief   Half periods per voice for the TIM2 toggle output
+ *
+ * Plain C++ without any HAL dependency.
+ * The task stages a retune, the audio ISR commits it at the next toggle
+ * of the channel, so the new frequency starts phase-continuously.
+ * While the chirp of the vario voice is active, every toggle advances it
+ * by the half period just finished instead.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOGGLE_PERIODS_H_
+#define TOGGLE_PERIODS_H_
+
+#include <stdint.h>
+#include "pieps.h" // audio_voice_t, retune_statistics_t
+#include "frequency_mapping.h"
+
+#define MAX_HALF_PERIOD		0xffff // 16 bit compare -> 183 Hz minimum
+#define INITIAL_HALF_PERIOD	12000  // 1 kHz
+
+class toggle_periods
+{
+public:
+  toggle_periods( retune_statistics_t &statistics)
+  : statistics( statistics)
+  {
+    for( unsigned v = 0; v < AUDIO_VOICES; ++v)
+      {
+	period[v] = INITIAL_HALF_PERIOD;
+	staged[v] = 0;
+      }
+  }
+
+  //! stage a new voice frequency, from task level
+  void retune( audio_voice_t v, uint16_t frequency_Hz)
+  {
+    uint32_t count = timer_period( frequency_Hz); // count = 12000 -> 1kHz
+    if( count > MAX_HALF_PERIOD)
+      count = MAX_HALF_PERIOD;
+
+    if( (count == period[v]) && (staged[v] == 0))
+      return;
+
+    if( __sync_lock_test_and_set( &staged[v], count) != 0)
+      ++statistics.coalesced;
+    ++statistics.deferred;
+  }
+
+  //! drop a staged retune, from task level
+  void cancel( audio_voice_t v)
+  {
+    __sync_lock_test_and_set( &staged[v], 0);
+  }
+
+  //! half period for the next toggle, for the audio ISR
+  template <class sweep_t> uint32_t next( audio_voice_t v, sweep_t &sweep)
+  {
+    if( (v == VARIO_VOICE) && sweep.is_active()) // elapsed = the half period just finished
+      {
+	uint32_t chirp = timer_period( sweep.step( period[v]));
+	period[v] = chirp > MAX_HALF_PERIOD ? MAX_HALF_PERIOD : chirp;
+	return period[v];
+      }
+
+    uint32_t commit = __sync_lock_test_and_set( &staged[v], 0);
+    if( commit)
+      {
+	period[v] = commit;
+	++statistics.applied;
+      }
+    return period[v];
+  }
+
+  //! half period in use
+  uint32_t get( audio_voice_t v) const
+  {
+    return period[v];
+  }
+
+private:
+  retune_statistics_t &statistics;
+  uint32_t period[AUDIO_VOICES];		//!< timer counts
+  volatile uint32_t staged[AUDIO_VOICES];	//!< 0 = nothing staged
+};
+
+#endif /* TOGGLE_PERIODS_H_ */
@@ -0,0 +1,179 @@
+/**
+ * @file    tone_curve.h
+ * @brief   Piecewise-linear vario tone mapping: climb value -> tone, cadence, duty
+ *
+ * Plain C++ without any HAL dependency.
+ * The curve input is the signed value sent in bytes 0..1 of
+ * c_CID_A57_Audio. Slopes are computed once when a curve is loaded,
+ * the evaluation needs one 64-bit multiplication per output and
+ * no division.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TONE_CURVE_H_
+#define TONE_CURVE_H_
+
+#include <stdint.h>
+
+#define TONE_CURVE_POINTS	8
+#define TONE_CURVE_MAX_FREQUENCY 8000	// Hz
+#define TONE_CURVE_MAX_PERIOD	2550	// ms, 0 = continuous tone
+#define TONE_PROFILE_MAGIC	0x54434e31 // "TCN1"
+
+typedef struct
+{
+  int16_t climb;	//!< curve input, strictly ascending
+  uint16_t frequency;	//!< Hz
+  uint16_t period_ms;	//!< beep cadence, 0 = continuous tone
+  uint8_t duty;		//!< tone on-time / period * 256
+  uint8_t reserved;
+} tone_curve_point_t;
+
+//! persistent record, stored in flash
+typedef struct
+{
+  uint32_t magic;
+  uint8_t selected;	//!< 0 = classic mapping, 1 = this profile
+  uint8_t points;
+  uint16_t chirp_low_Hz;	//!< speed commander chirp range
+  uint16_t chirp_high_Hz;
+  uint16_t reserved;
+  tone_curve_point_t point[TONE_CURVE_POINTS];
+  uint32_t checksum;
+} tone_profile_t;
+
+inline uint32_t tone_profile_checksum( const tone_profile_t &profile)
+{
+  const uint16_t *data = (const uint16_t *)&profile;
+  uint32_t sum = 0;
+  for( unsigned i = 0; i < (sizeof( tone_profile_t) - sizeof( uint32_t)) / 2; ++i)
+    sum = ((sum << 1) | (sum >> 31)) + data[i];
+  return ~sum;
+}
+
+class tone_curve
+{
+public:
+  tone_curve( void)
+  : chirp_low_Hz( 0),
+    chirp_high_Hz( 0),
+    points( 0)
+  {}
+
+  //! check and take over a profile's curve, slopes are computed here
+  bool load( const tone_profile_t &profile)
+  {
+    if( (profile.points < 2) || (profile.points > TONE_CURVE_POINTS))
+      return false;
+    for( unsigned i = 0; i < profile.points; ++i)
+      {
+	const tone_curve_point_t &p = profile.point[i];
+	if( (p.frequency == 0) || (p.frequency > TONE_CURVE_MAX_FREQUENCY)
+	    || (p.period_ms > TONE_CURVE_MAX_PERIOD))
+	  return false;
+	if( (p.period_ms != 0) && (((p.period_ms * p.duty) >> 8) == 0))
+	  return false; // duty 0 or below 1ms on time: the cadence mutes the vario
+	if( (i > 0) && (p.climb <= profile.point[i - 1].climb))
+	  return false;
+      }
+    if( (profile.chirp_low_Hz == 0) || (profile.chirp_low_Hz >= profile.chirp_high_Hz)
+	|| (profile.chirp_high_Hz > TONE_CURVE_MAX_FREQUENCY))
+      return false;
+
+    for( unsigned i = 0; i < profile.points; ++i)
+      point[i] = profile.point[i];
+    for( unsigned i = 0; i + 1 < profile.points; ++i)
+      {
+	int32_t dx = point[i + 1].climb - point[i].climb;
+	frequency_slope[i] = ((int32_t)point[i + 1].frequency - point[i].frequency) * 65536 / dx;
+	period_slope[i]    = ((int32_t)point[i + 1].period_ms - point[i].period_ms) * 65536 / dx;
+	duty_slope[i]      = ((int32_t)point[i + 1].duty      - point[i].duty)      * 65536 / dx;
+      }
+    chirp_low_Hz = profile.chirp_low_Hz;
+    chirp_high_Hz = profile.chirp_high_Hz;
+    points = profile.points;
+    return true;
+  }
+
+  uint16_t get_chirp_low( void) const
+  {
+    return chirp_low_Hz;
+  }
+
+  uint16_t get_chirp_high( void) const
+  {
+    return chirp_high_Hz;
+  }
+
+  bool is_valid( void) const
+  {
+    return points >= 2;
+  }
+
+  //! tone for climb, period 0 = continuous tone
+  void evaluate( int16_t climb, uint16_t &frequency, uint16_t &period_ms, uint16_t &on_ms) const
+  {
+    if( climb <= point[0].climb)
+      {
+	take( point[0], frequency, period_ms, on_ms);
+	return;
+      }
+    if( climb >= point[points - 1].climb)
+      {
+	take( point[points - 1], frequency, period_ms, on_ms);
+	return;
+      }
+
+    unsigned i = 0;
+    while( climb >= point[i + 1].climb)
+      ++i;
+
+    int64_t dx = climb - point[i].climb;
+    frequency = point[i].frequency + (int32_t)( (dx * frequency_slope[i]) >> 16);
+
+    // a segment between chopped and continuous tone does not blend
+    if( (point[i].period_ms == 0) || (point[i + 1].period_ms == 0))
+      period_ms = point[i].period_ms;
+    else
+      period_ms = point[i].period_ms + (int32_t)( (dx * period_slope[i]) >> 16);
+
+    uint32_t duty = point[i].duty + (int32_t)( (dx * duty_slope[i]) >> 16);
+    on_ms = (period_ms * duty) >> 8;
+  }
+
+private:
+  static void take( const tone_curve_point_t &p, uint16_t &frequency, uint16_t &period_ms, uint16_t &on_ms)
+  {
+    frequency = p.frequency;
+    period_ms = p.period_ms;
+    on_ms = (p.period_ms * p.duty) >> 8;
+  }
+
+  tone_curve_point_t point[TONE_CURVE_POINTS];
+  int32_t frequency_slope[TONE_CURVE_POINTS - 1];	//!< Q16 per climb unit
+  int32_t period_slope[TONE_CURVE_POINTS - 1];
+  int32_t duty_slope[TONE_CURVE_POINTS - 1];
+  uint16_t chirp_low_Hz;
+  uint16_t chirp_high_Hz;
+  unsigned points;
+};
+
+#endif /* TONE_CURVE_H_ */
@@ -0,0 +1,169 @@
+/**
+ * @file    tone_profile.cpp
+ * @brief   Vario tone profile: upload via CAN, persistence in flash
+ *
+ * The profile lives in the last 1 kByte flash page. The linker script
+ * takes this page out of the FLASH region and reserves it as a NOLOAD
+ * section: it is no part of the firmware image, so reflashing the
+ * firmware keeps the profile and no image data ever shares the page.
+ * It is read through a volatile pointer as it changes under the program.
+ * Erasing and programming stall the CPU for some 20ms, audio ISRs
+ * included. This is acceptable for a configuration change on ground:
+ * the flash is only written if its contents change and never while
+ * vario data is arriving.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+#include "main.h"
+#include "system_configuration.h"
+#include "stm32f1xx_hal.h"
+#include "tone_profile.h"
+
+#if RUN_AUDIO_CONTROLLER
+
+#define PERIOD_UNIT_MS	10
+
+typedef union
+{
+  tone_profile_t profile;
+  uint8_t page[FLASH_PAGE_SIZE];
+} tone_profile_page_t;
+
+//! flash page reserved by the linker script, erased = no magic
+extern "C" const tone_profile_page_t __tone_profile_begin__;
+
+static tone_profile_t staged;	//!< profile under construction
+static tone_curve curve;	//!< stored profile, ready for evaluation
+static bool profile_selected;
+
+//!< copy the flash page contents
+static void read_stored( tone_profile_t &profile)
+{
+  const volatile uint16_t *source = (const volatile uint16_t *)&__tone_profile_begin__;
+  uint16_t *destination = (uint16_t *)&profile;
+  for( unsigned i = 0; i < sizeof( tone_profile_t) / 2; ++i)
+    destination[i] = source[i];
+}
+
+static bool store( tone_profile_t &profile)
+{
+  profile.magic = TONE_PROFILE_MAGIC;
+  profile.checksum = tone_profile_checksum( profile);
+
+  uint32_t address = (uint32_t)&__tone_profile_begin__;
+  FLASH_EraseInitTypeDef erase = {0};
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.PageAddress = address;
+  erase.NbPages = 1;
+  uint32_t page_error;
+
+  HAL_FLASH_Unlock();
+  bool success = HAL_FLASHEx_Erase( &erase, &page_error) == HAL_OK;
+  const uint16_t *data = (const uint16_t *)&profile;
+  for( unsigned i = 0; success && (i < sizeof( tone_profile_t) / 2); ++i)
+    success = HAL_FLASH_Program( FLASH_TYPEPROGRAM_HALFWORD, address + 2 * i, data[i]) == HAL_OK;
+  HAL_FLASH_Lock();
+  return success;
+}
+
+void init_tone_profile( void)
+{
+  read_stored( staged);
+  if( (staged.magic != TONE_PROFILE_MAGIC) || (staged.checksum != tone_profile_checksum( staged)))
+    {
+      staged = tone_profile_t();
+      return;
+    }
+  profile_selected = curve.load( staged) && staged.selected;
+}
+
+bool tone_profile_command( const CAN_packet &p, bool flash_allowed)
+{
+  if( p.dlc < 2)
+    return false;
+
+  switch( p.data_b[0])
+  {
+    case TONE_PROFILE_POINT:
+      if( (p.dlc < 8) || (p.data_b[1] >= TONE_CURVE_POINTS))
+	return false;
+      {
+	tone_curve_point_t &point = staged.point[p.data_b[1]];
+	point.climb = p.data_sh[1];
+	point.frequency = p.data_h[2];
+	point.period_ms = p.data_b[6] * PERIOD_UNIT_MS;
+	point.duty = p.data_b[7];
+	point.reserved = 0;
+      }
+      return false;
+
+    case TONE_PROFILE_CHIRP:
+      if( p.dlc < 6)
+	return false;
+      staged.chirp_low_Hz = p.data_h[1];
+      staged.chirp_high_Hz = p.data_h[2];
+      return false;
+
+    case TONE_PROFILE_COMMIT:
+      {
+	if( ! flash_allowed)
+	  return false;
+	staged.points = p.data_b[1];
+	staged.selected = 1;
+	tone_curve candidate;
+	if( ! candidate.load( staged) || ! store( staged))
+	  return false;
+	curve = candidate;
+	profile_selected = true;
+      }
+      return true;
+
+    case TONE_PROFILE_SELECT:
+      {
+	bool select = p.data_b[1] != 0;
+	if( select && ! curve.is_valid())
+	  return false;
+	if( curve.is_valid())
+	  {
+	    tone_profile_t stored;
+	    read_stored( stored);
+	    if( (stored.selected != 0) != select)
+	      {
+		stored.selected = select;
+		if( ! flash_allowed || ! store( stored))
+		  return false;
+	      }
+	  }
+	profile_selected = select;
+      }
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+const tone_curve * active_tone_curve( void)
+{
+  return profile_selected ? &curve : 0;
+}
+
+#endif
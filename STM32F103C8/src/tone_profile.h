@@ -0,0 +1,58 @@
+/**
+ * @file    tone_profile.h
+ * @brief   Vario tone profile: upload via CAN, persistence in flash
+ *
+ * Commands in byte 0 of c_CID_AUD_Tone_Profile_CMD:
+ *
+ * TONE_PROFILE_POINT:  b1 index, b2..3 int16_t climb, b4..5 uint16_t Hz,
+ *                      b6 period / 10ms (0 = continuous), b7 duty / 256
+ * TONE_PROFILE_CHIRP:  b2..3 uint16_t chirp low Hz, b4..5 uint16_t chirp high Hz
+ * TONE_PROFILE_COMMIT: b1 number of points -> check, store to flash and select
+ * TONE_PROFILE_SELECT: b1 0 = classic mapping, 1 = stored profile (persistent)
+ *
+ * COMMIT and a SELECT changing the stored choice write the flash,
+ * they are refused unless flash_allowed.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TONE_PROFILE_H_
+#define TONE_PROFILE_H_
+
+#include "tone_curve.h"
+#include "CAN.h"
+
+enum tone_profile_command_t
+{
+  TONE_PROFILE_POINT,
+  TONE_PROFILE_CHIRP,
+  TONE_PROFILE_COMMIT,
+  TONE_PROFILE_SELECT
+};
+
+void init_tone_profile( void); //!< load the stored profile from flash
+
+//! handle one c_CID_AUD_Tone_Profile_CMD frame, true if the active mapping changed
+bool tone_profile_command( const CAN_packet &p, bool flash_allowed);
+
+//! curve to be used, 0 = classic mapping
+const tone_curve * active_tone_curve( void);
+
+#endif /* TONE_PROFILE_H_ */
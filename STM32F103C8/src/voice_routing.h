@@ -0,0 +1,119 @@
+/**
+ * @file    voice_routing.h
+ * @brief   Ladder targets and channel assignment from the voice requests
+ *
+ * Plain C++ without any HAL dependency.
+ * The task requests level and on / off per voice, the result is the
+ * envelope target while the vario gate is open and while it is closed,
+ * and the voice each tone channel carries. The ladder follows the louder
+ * voice, while a signal sounds it belongs to the signal during the off
+ * phase of the cadence. A single voice runs on both channels.
+ * While both voices are silent the assignment is kept for the release.
+ *
+ * @author  Dr. Klaus Schaefer klaus.schaefer@h-da.de
+
+ * @license 	This project is released under the GNU Public License GPL-3.0
+
+    <Larus Flight Sensor Firmware>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VOICE_ROUTING_H_
+#define VOICE_ROUTING_H_
+
+#include <stdint.h>
+#include "pieps.h"
+
+class voice_routing
+{
+public:
+  voice_routing( void)
+  : open_target( 0),
+    closed_target( 0)
+  {
+    for( unsigned v = 0; v < AUDIO_VOICES; ++v)
+      {
+	level[v] = 0;
+	on[v] = false;
+      }
+    channel_voice[0] = channel_voice[1] = VARIO_VOICE;
+  }
+
+  //! envelope level requested for a voice, from task level, update() takes it over
+  void set_level( audio_voice_t v, uint16_t new_level)
+  {
+    level[v] = new_level;
+  }
+
+  //! voice on or off, from task level, update() takes it over
+  void set_on( audio_voice_t v, bool activated)
+  {
+    on[v] = activated;
+  }
+
+  //! channel voices the requests ask for, false while silent
+  bool assignment( audio_voice_t &ch1_voice, audio_voice_t &ch2_voice) const
+  {
+    bool vario_on = on[VARIO_VOICE];
+    bool signal_on = on[SIGNAL_VOICE];
+    ch1_voice = (vario_on || ! signal_on) ? VARIO_VOICE : SIGNAL_VOICE;
+    ch2_voice = signal_on ? SIGNAL_VOICE : VARIO_VOICE;
+    return vario_on || signal_on;
+  }
+
+  //! take the requests over: ladder targets and, unless silent, channel voices
+  void update( void)
+  {
+    uint16_t closed = on[SIGNAL_VOICE] ? level[SIGNAL_VOICE] : 0;
+    uint16_t open = closed;
+    if( on[VARIO_VOICE] && (level[VARIO_VOICE] > open))
+      open = level[VARIO_VOICE];
+
+    audio_voice_t ch1_voice, ch2_voice;
+    if( assignment( ch1_voice, ch2_voice)) // silent: keep the assignment for the release
+      {
+	channel_voice[0] = ch1_voice;
+	channel_voice[1] = ch2_voice;
+      }
+    open_target = open;
+    closed_target = closed;
+  }
+
+  //! envelope target for the present vario gate state, for the audio ISR
+  uint16_t target( bool gate_open) const
+  {
+    return gate_open ? open_target : closed_target;
+  }
+
+  //! voice on CH1 (0) or CH2 (1), for the audio ISR
+  audio_voice_t channel( unsigned ch) const
+  {
+    return channel_voice[ch];
+  }
+
+  uint16_t get_level( audio_voice_t v) const
+  {
+    return level[v];
+  }
+
+private:
+  volatile uint16_t level[AUDIO_VOICES];	//!< envelope level per voice
+  volatile bool on[AUDIO_VOICES];
+  volatile uint16_t open_target;		//!< envelope target during the vario on phase
+  volatile uint16_t closed_target;		//!< and during its off phase
+  volatile audio_voice_t channel_voice[2];	//!< CH1 = PA0, CH2 = PA1
+};
+
+#endif /* VOICE_ROUTING_H_ */